@@ -0,0 +1,245 @@
+#include "AccuracyTest.h"
+#include "../../Source/FastMath.h"
+#include "../../Source/Filter.h"
+#include "../../Source/Synth.h"
+#include "../../Source/ParameterMapping.h"
+#include <iostream>
+#include <type_traits>
+
+using FastMath::SIMD;
+
+// The sample rates that the pitch and cutoff are checked at.
+static const double sampleRates[] = { 44100.0, 48000.0, 96000.0, 192000.0 };
+
+static double cents(double actual, double expected)
+{
+    return std::abs(1200.0 * std::log2(actual / expected));
+}
+
+struct Check
+{
+    const char* name;
+    const char* unit;
+    double maxError = 0.0;
+    double bound;
+    int mismatches = 0;  // SIMD results that differ from the scalar ones
+};
+
+static int report(const Check& check)
+{
+    bool passed = check.maxError <= check.bound && check.mismatches == 0;
+    std::cout << (passed ? "ok      " : "FAIL    ") << check.name << ": max error "
+              << check.maxError << " " << check.unit << " (bound " << check.bound << ")";
+    if (check.mismatches > 0) {
+        std::cout << ", " << check.mismatches << " SIMD results differ";
+    }
+    std::cout << "\n";
+    return passed ? 0 : 1;
+}
+
+// Evaluates a function at `count` points between `low` and `high`, and
+// compares it with the reference. For the functions that have a SIMD
+// version, that must give exactly the same results as the scalar one. Pass
+// nullptr as `vector` for the others.
+template<typename Scalar, typename Vector, typename Reference>
+static int checkFunction(const char* name, double low, double high, bool relative, double bound,
+                         Scalar&& scalar, Vector&& vector, Reference&& reference)
+{
+    constexpr bool hasVector = !std::is_same_v<std::decay_t<Vector>, std::nullptr_t>;
+
+    Check check { name, relative ? "relative" : "absolute", 0.0, bound };
+    const int count = 1 << 20;
+
+    alignas(SIMD::SIMDRegisterSize) float x[SIMD::SIMDNumElements];
+    for (int i = 0; i < count; i += int(SIMD::size())) {
+        for (size_t lane = 0; lane < SIMD::size(); ++lane) {
+            double t = double(i + int(lane)) / double(count - 1);
+            x[lane] = float(juce::jmin(high, low + (high - low) * t));
+        }
+
+        SIMD y = SIMD::fromRawArray(x);
+        if constexpr (hasVector) {
+            y = vector(y);
+        }
+        for (size_t lane = 0; lane < SIMD::size(); ++lane) {
+            float approx = scalar(x[lane]);
+            double exact = reference(double(x[lane]));
+            double error = std::abs(double(approx) - exact);
+            if (relative && exact != 0.0) {
+                error /= std::abs(exact);
+            }
+            check.maxError = std::max(check.maxError, error);
+            if (hasVector && y.get(lane) != approx) {
+                check.mismatches += 1;
+            }
+        }
+    }
+    return report(check);
+}
+
+// Synth::calcPeriod and the glide in Synth::startVoice. The oscillator period
+// is proportional to these, so their relative error is the pitch error.
+static int checkPitch()
+{
+    Check check { "pitch (calcPeriod, glide)", "cents", 0.0, 0.001 };
+    for (int note = 0; note < 128; ++note) {
+        // calcPeriod, including the analog drift of every voice.
+        for (int v = 0; v < Synth::MAX_VOICES; ++v) {
+            float x = -0.05776226505f * (float(note) + Synth::analogDrift(v));
+            check.maxError = std::max(check.maxError,
+                                      cents(FastMath::expApprox(x), std::exp(double(x))));
+        }
+
+        for (int detune = -8; detune <= 8; ++detune) {
+            // Glide from a note up to 127 semitones away, with glide bend.
+            float glide = (float(note - 64) - 0.5f * float(detune)) / 12.0f;
+            check.maxError = std::max(check.maxError,
+                                      cents(FastMath::exp2Approx(glide), std::exp2(double(glide))));
+        }
+    }
+    return report(check);
+}
+
+// The analog drift is meant to be subtle, also with 128 voices, so it must
+// stay within a cent and a half of the note.
+static int checkAnalogDrift()
+{
+    Check check { "analog drift (calcPeriod)", "cents", 0.0, 1.5 };
+    for (int v = 0; v < Synth::MAX_VOICES; ++v) {
+        check.maxError = std::max(check.maxError, std::abs(100.0 * double(Synth::analogDrift(v))));
+    }
+    return report(check);
+}
+
+// Filter::updateCoefficients uses g = tan(PI * cutoff / sampleRate), and
+// rampCoefficients looks up g in a CutoffTable. The cutoff that the filter
+// really has follows from g with atan. The cutoff modulation in
+// Voice::updateLFO multiplies the cutoff by an exp(), which goes straight
+// into the cutoff error.
+static int checkCutoff()
+{
+    Check check { "filter cutoff (updateCoefficients)", "cents", 0.0, 0.001 };
+    Check table { "filter cutoff (CutoffTable)", "cents", 0.0, 0.01 };
+    CutoffTable cutoffTable;
+
+    for (double sampleRate : sampleRates) {
+        cutoffTable.prepare(float(sampleRate));
+        for (int i = 0; i <= 10000; ++i) {
+            // The same range as the clamp in Voice::updateLFO.
+            float cutoff = float(30.0 * std::pow(20000.0 / 30.0, double(i) / 10000.0));
+            float x = 3.1415926535897932f * cutoff / float(sampleRate);
+            double actual = std::atan(double(FastMath::tanApprox(x))) * sampleRate
+                          / juce::MathConstants<double>::pi;
+            double expected = double(x) * sampleRate / juce::MathConstants<double>::pi;
+            check.maxError = std::max(check.maxError, cents(actual, expected));
+
+            actual = std::atan(double(cutoffTable.lookup(cutoff))) * sampleRate
+                   / juce::MathConstants<double>::pi;
+            table.maxError = std::max(table.maxError, cents(actual, double(cutoff)));
+        }
+    }
+
+    Check modulation { "filter cutoff (modulation)", "cents", 0.0, 0.001 };
+    for (int i = 0; i <= 100000; ++i) {
+        float x = -10.0f + 20.0f * float(i) / 100000.0f;
+        modulation.maxError = std::max(modulation.maxError,
+                                       cents(FastMath::expApprox(x), std::exp(double(x))));
+    }
+    return report(check) + report(table) + report(modulation);
+}
+
+// Renders every factory preset with and without VoiceBank and compares the
+// outputs. The difference is relative to the loudest sample of the render.
+static int checkVoiceBank()
+{
+    Check check { "VoiceBank vs. Voice::renderBlock", "relative", 0.0, VoiceBank::TOLERANCE };
+
+    const double sampleRate = 48000.0;
+    const int blockSize = 512;
+    const int numBlocks = int(sampleRate) / blockSize;  // about one second
+
+    std::vector<Preset> presets;
+    createFactoryPresets(presets);
+
+    for (const Preset& preset : presets) {
+        std::vector<float> outputs[2];
+        for (int bank = 0; bank < 2; ++bank) {
+            auto synth = std::make_unique<Synth>();
+            synth->useVoiceBank = (bank == 1);
+            synth->allocateResources(sampleRate, blockSize);
+            float values[NUM_PARAMS];
+            std::copy(preset.param, preset.param + NUM_PARAMS, values);
+            applyParameters(*synth, values, float(sampleRate), ALL_PARAMS);
+            synth->reset();
+
+            // Enough notes to fill all the lanes, released halfway through.
+            juce::AudioBuffer<float> buffer(2, blockSize);
+            float* outputBuffers[2] = { buffer.getWritePointer(0), buffer.getWritePointer(1) };
+            for (int note = 0; note < 2 * VoiceBank::LANES; ++note) {
+                synth->midiMessage(0x90, uint8_t(36 + note * 5), uint8_t(60 + note * 4));
+            }
+            for (int i = 0; i < numBlocks; ++i) {
+                if (i == numBlocks / 2) {
+                    for (int note = 0; note < 2 * VoiceBank::LANES; ++note) {
+                        synth->midiMessage(0x80, uint8_t(36 + note * 5), 0);
+                    }
+                }
+                synth->render(outputBuffers, blockSize);
+                for (int channel = 0; channel < 2; ++channel) {
+                    const float* samples = buffer.getReadPointer(channel);
+                    outputs[bank].insert(outputs[bank].end(), samples, samples + blockSize);
+                }
+            }
+            synth->deallocateResources();
+        }
+
+        double peak = 0.0;
+        double maxDiff = 0.0;
+        for (size_t i = 0; i < outputs[0].size(); ++i) {
+            peak = std::max(peak, double(std::abs(outputs[0][i])));
+            maxDiff = std::max(maxDiff, double(std::abs(outputs[0][i] - outputs[1][i])));
+        }
+        if (peak > 0.0) {
+            check.maxError = std::max(check.maxError, maxDiff / peak);
+        }
+    }
+    return report(check);
+}
+
+int runAccuracyTest()
+{
+    int numFailed = 0;
+
+    numFailed += checkFunction("exp2", -32.0, 32.0, true, 1e-7,
+        [](float x) { return FastMath::exp2Approx(x); },
+        [](SIMD x) { return FastMath::exp2Approx(x); },
+        [](double x) { return std::exp2(x); });
+
+    numFailed += checkFunction("exp", -20.0, 20.0, true, 1e-6,
+        [](float x) { return FastMath::expApprox(x); },
+        [](SIMD x) { return FastMath::expApprox(x); },
+        [](double x) { return std::exp(x); });
+
+    numFailed += checkFunction("sin", -100.0, 100.0, false, 3e-7,
+        [](float x) { return FastMath::sinApprox(x); },
+        nullptr,
+        [](double x) { return std::sin(x); });
+
+    numFailed += checkFunction("cos", -100.0, 100.0, false, 5e-7,
+        [](float x) { return FastMath::cosApprox(x); },
+        nullptr,
+        [](double x) { return std::cos(x); });
+
+    numFailed += checkFunction("tan", 0.0, 1.5, true, 8e-7,
+        [](float x) { return FastMath::tanApprox(x); },
+        nullptr,
+        [](double x) { return std::tan(x); });
+
+    numFailed += checkPitch();
+    numFailed += checkAnalogDrift();
+    numFailed += checkCutoff();
+    numFailed += checkVoiceBank();
+
+    std::cout << (numFailed == 0 ? "All accuracy checks passed\n" : "Some accuracy checks failed\n");
+    return numFailed;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// Checks the FastMath approximations against the double precision functions
+// from the standard library. First the functions themselves are tested over
+// the input ranges that FastMath.h documents, and the SIMD versions of exp2
+// and exp must give exactly the same results as the scalar ones. Then the
+// errors are measured the way they are heard: as pitch errors of the
+// oscillators and as cutoff errors of the filter, in cents. Finally, every
+// factory preset is rendered with and without VoiceBank, and the outputs
+// are compared.
+//
+// Returns the number of checks that exceeded their bounds.
+int runAccuracyTest();
@@ -0,0 +1,847 @@
+/*
+  ==============================================================================
+
+    JX11Bench: measures how fast the DSP building blocks are.
+
+    Usage:
+      JX11Bench [--out=results.csv] [--seconds=0.5] [--threads=0]
+                [--preset=N] [--rate=48000] [--block=512] [--micro-only]
+                [--control-rate=2] [--oversampling=0]
+      JX11Bench --accuracy
+
+    First each building block is timed by itself: the oscillators, filter,
+    envelope, noise generator, Voice, the FastMath approximations, the
+    parameter conversion, and note on and off with every voice playing, so
+    that each note steals a voice. Then Synth::render is timed with 0, 1, 8
+    and MAX_VOICES notes playing, for all factory presets, at 44.1, 48, 96
+    and 192 kHz, and with block sizes from 16 to 2048 samples. With 0 notes
+    this measures what an idle instance of the plug-in costs. The options
+    limit this to a single preset, sample rate or block size.
+
+    Next to the time that the BLIT and PolyBLEP engines take per sample,
+    the aliasing test plays a sawtooth near C7 with each of them and writes
+    a comment line with how much of its energy is between the harmonics.
+    That is what decides whether the slower BLIT is worth it for offline
+    renders.
+
+    The CC flood benchmark plays 8 notes while the mod wheel, aftertouch and
+    pitch bend each change 1000 times per second. It splits the blocks with
+    EventScheduler for every MIDI Timing choice and reports the number of
+    segments per block as a comment line, followed by the render time.
+
+    The volume sweep benchmark plays 8 notes while CC 7 sweeps the output
+    level, and checks that the host gets one notification per 30th of a
+    second instead of one per message, and that no block is much slower.
+
+    --control-rate picks the Control Rate parameter by its index: 0 - 3 are
+    8, 16, 32 and 64 samples, 4 - 6 are 1, 2 and 4 kHz. Run the benchmark
+    once for each to see what the modulation resolution costs. Likewise,
+    --oversampling picks the Oversampling parameter: 0 is off, 1 is 2x and
+    2 is 4x. The decimation filters that bring the oversampled voices back
+    to the host's sample rate are always timed for both factors.
+
+    The results are written as CSV, one line per measurement. The unit is
+    either "sample" or "call"; updateCoefficients, updateLFO and
+    applyParameters are called once per control period, not per sample.
+    Cycles are estimated from the nominal clock speed of the CPU, so they
+    are only comparable between runs on the same machine.
+
+    With --accuracy, nothing is timed. Instead the FastMath approximations
+    are checked against the standard library, including the pitch and cutoff
+    errors that they cause, in cents. Every factory preset is also rendered
+    with and without VoiceBank, which must give the same output within
+    VoiceBank::TOLERANCE. The exit code is 1 if any of the errors is larger
+    than its bound.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <fstream>
+#include <iostream>
+#include "../../Source/Synth.h"
+#include "../../Source/ParameterMapping.h"
+#include "../../Source/EventScheduler.h"
+#include "../../Source/HostNotifications.h"
+#include "AccuracyTest.h"
+
+// Keeps the compiler from optimizing away the code that is being measured.
+static volatile float sink;
+
+struct Result
+{
+    const char* benchmark;
+    juce::String preset;
+    double sampleRate;
+    int blockSize;
+    int notes;
+    double activeVoices;
+    const char* unit;
+    double count;
+    double seconds;
+};
+
+static double cpuHz = 0.0;
+
+static void writeHeader(std::ostream& out)
+{
+    out << "benchmark,preset,sampleRate,blockSize,notes,activeVoices,unit,count,"
+        << "seconds,nsPerUnit,nsPerUnitPerVoice,cyclesPerUnitPerVoice\n";
+}
+
+static void writeResult(std::ostream& out, const Result& r)
+{
+    double nsPerUnit = r.seconds * 1e9 / r.count;
+    double nsPerUnitPerVoice = nsPerUnit / juce::jmax(1.0, r.activeVoices);
+    double cycles = nsPerUnitPerVoice * cpuHz / 1e9;
+
+    out << r.benchmark << ",\"" << r.preset << "\"," << r.sampleRate << ","
+        << r.blockSize << "," << r.notes << "," << r.activeVoices << ","
+        << r.unit << "," << r.count << "," << r.seconds << ","
+        << nsPerUnit << "," << nsPerUnitPerVoice << "," << cycles << "\n";
+    out.flush();
+}
+
+static double now()
+{
+    return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks());
+}
+
+// Runs the function a few times and returns the fastest time. The slower
+// runs were most likely disturbed by something else on the machine.
+template<typename Function>
+static double measure(Function&& function)
+{
+    double best = 1e30;
+    for (int repeat = 0; repeat < 5; ++repeat) {
+        double start = now();
+        function();
+        best = juce::jmin(best, now() - start);
+    }
+    return best;
+}
+
+// Puts a voice in the same state as Synth::startVoice would for middle C,
+// but with full sustain so that it never stops playing.
+static void prepareVoice(Voice& voice, float sampleRate, bool polyBLEP, const CutoffTable& table,
+                         int controlPeriod)
+{
+    voice.reset();
+    voice.note = 60;
+    voice.polyBLEP = polyBLEP;
+    voice.period = sampleRate / 261.63f;
+    voice.target = voice.period;
+    voice.osc1.period = voice.period;
+    voice.osc1.amplitude = 0.5f;
+    voice.osc2.period = voice.period * 0.99f;
+    voice.osc2.amplitude = 0.5f * 0.8f;
+    voice.glideRate = 1.0f;
+    voice.pitchBend = 1.0f;
+    voice.filterEnvDepth = 1.0f;
+    voice.filterMod = 0.0f;
+    voice.filterQ = 2.0f;
+    voice.cutoff = 2000.0f;
+    voice.filter.sampleRate = sampleRate;
+    voice.filter.cutoffTable = &table;
+    voice.filter.rampLength = controlPeriod;
+    voice.filter.updateCoefficients(voice.cutoff, voice.filterQ);
+
+    voice.env.attackMultiplier = 0.99f;
+    voice.env.decayMultiplier = 0.999f;
+    voice.env.sustainLevel = 1.0f;
+    voice.env.releaseMultiplier = 0.999f;
+    voice.env.attack();
+
+    voice.filterEnv.attackMultiplier = 0.9f;
+    voice.filterEnv.decayMultiplier = 0.99f;
+    voice.filterEnv.sustainLevel = 0.5f;
+    voice.filterEnv.releaseMultiplier = 0.99f;
+    voice.filterEnv.attack();
+}
+
+static void runMicroBenchmarks(std::ostream& out, double sampleRate, const float* presetValues,
+                               int controlRate, int oversampling)
+{
+    const int n = int(sampleRate);  // one second of audio
+    const float rate = float(sampleRate);
+    const float period = rate / 220.0f;
+    const int controlPeriod = controlPeriodForChoice(controlRate, rate, 1);
+
+    CutoffTable cutoffTable;
+    cutoffTable.prepare(rate);
+
+    std::vector<float> noise(size_t(n), 0.0f);
+    NoiseGenerator noiseGen;
+    noiseGen.reset();
+    for (auto& x : noise) { x = noiseGen.nextValue() * 0.1f; }
+
+    auto report = [&](const char* name, const char* unit, int count, double seconds) {
+        writeResult(out, { name, "-", sampleRate, 0, 1, 1.0, unit, double(count), seconds });
+    };
+
+    {
+        Oscillator osc;
+        double t = measure([&] {
+            osc.reset();
+            osc.period = period;
+            float sum = 0.0f;
+            for (int i = 0; i < n; ++i) { sum += osc.nextSample(); }
+            sink = sum;
+        });
+        report("Oscillator::nextSample", "sample", n, t);
+    }
+    {
+        Oscillator osc;
+        double t = measure([&] {
+            osc.reset();
+            osc.period = period;
+            float sum = 0.0f;
+            for (int i = 0; i < n; ++i) { sum += osc.nextSawtooth(); }
+            sink = sum;
+        });
+        report("Oscillator::nextSawtooth", "sample", n, t);
+    }
+    {
+        Filter filter;
+        filter.sampleRate = rate;
+        filter.reset();
+        const int calls = n / controlPeriod;
+        double t = measure([&] {
+            // Render one sample per call, or the compiler would only keep
+            // the last call. This is included in the time.
+            float sum = 0.0f;
+            for (int i = 0; i < calls; ++i) {
+                filter.updateCoefficients(100.0f + float(i & 1023) * 10.0f, 2.0f);
+                sum += filter.render(noise[size_t(i)]);
+            }
+            sink = sum;
+        });
+        report("Filter::updateCoefficients", "call", calls, t);
+    }
+    {
+        // What Voice::updateLFO uses: the cutoff table and coefficient ramps.
+        // Also renders a whole control period per call.
+        Filter filter;
+        filter.sampleRate = rate;
+        filter.cutoffTable = &cutoffTable;
+        filter.rampLength = controlPeriod;
+        filter.reset();
+        const int calls = n / controlPeriod;
+        double t = measure([&] {
+            float sum = 0.0f;
+            for (int i = 0; i < calls; ++i) {
+                filter.rampCoefficients(100.0f + float(i & 1023) * 10.0f, 2.0f);
+                for (int j = 0; j < controlPeriod; ++j) {
+                    sum += filter.render(noise[size_t(i * controlPeriod + j)]);
+                }
+            }
+            sink = sum;
+        });
+        report("Filter::rampCoefficients + render", "sample", calls * controlPeriod, t);
+    }
+    {
+        Filter filter;
+        filter.sampleRate = rate;
+        filter.reset();
+        filter.updateCoefficients(1000.0f, 2.0f);
+        double t = measure([&] {
+            float sum = 0.0f;
+            for (int i = 0; i < n; ++i) { sum += filter.render(noise[size_t(i)]); }
+            sink = sum;
+        });
+        report("Filter::render", "sample", n, t);
+    }
+    {
+        Envelope env;
+        env.reset();
+        env.attackMultiplier = 0.999f;
+        env.decayMultiplier = 0.9999f;
+        env.sustainLevel = 0.5f;
+        env.releaseMultiplier = 0.9999f;
+        double t = measure([&] {
+            env.attack();
+            float sum = 0.0f;
+            for (int i = 0; i < n; ++i) { sum += env.nextValue(); }
+            sink = sum;
+        });
+        report("Envelope::nextValue", "sample", n, t);
+    }
+    {
+        NoiseGenerator gen;
+        gen.reset();
+        double t = measure([&] {
+            float sum = 0.0f;
+            for (int i = 0; i < n; ++i) { sum += gen.nextValue(); }
+            sink = sum;
+        });
+        report("NoiseGenerator::nextValue", "sample", n, t);
+    }
+    {
+        // The check on the synth's output, in blocks of 512 samples that are
+        // all in range, which is the common case.
+        const int blockSize = 512;
+        OutputProtectionCounters counters;
+        const int blocks = n / blockSize;
+        double t = measure([&] {
+            for (int i = 0; i < blocks; ++i) {
+                protectYourEars(noise.data() + i * blockSize, blockSize, counters);
+            }
+            sink = noise[0];
+        });
+        report("protectYourEars", "sample", blocks * blockSize, t);
+    }
+    for (int factor = 2; factor <= Decimator::MAX_FACTOR; factor *= 2) {
+        // One channel, in blocks of 512 samples at the host's rate. The time
+        // is per output sample.
+        const int blockSize = 512;
+        Decimator decimator;
+        decimator.prepare(blockSize);
+        std::vector<float> input(size_t(blockSize * factor), 0.0f);
+        std::vector<float> output(size_t(blockSize), 0.0f);
+        const int blocks = n / blockSize;
+        double t = measure([&] {
+            float sum = 0.0f;
+            for (int i = 0; i < blocks; ++i) {
+                std::copy(noise.begin(), noise.begin() + blockSize * factor, input.begin());
+                decimator.process(input.data(), output.data(), blockSize, factor);
+                sum += output[0];
+            }
+            sink = sum;
+        });
+        report(factor == 2 ? "Decimator (2x)" : "Decimator (4x)", "sample", blocks * blockSize, t);
+    }
+
+    // The approximations from FastMath compared to the standard library, with
+    // inputs in the range that the synth uses them for.
+    auto measureMath = [&](const char* name, auto function, float low, float high) {
+        double t = measure([&] {
+            float sum = 0.0f;
+            float x = low;
+            const float step = (high - low) / float(n);
+            for (int i = 0; i < n; ++i) {
+                sum += function(x);
+                x += step;
+            }
+            sink = sum;
+        });
+        report(name, "call", n, t);
+    };
+    measureMath("FastMath::tanApprox", [](float x) { return FastMath::tanApprox(x); }, 0.0f, 1.5f);
+    measureMath("std::tan", [](float x) { return std::tan(x); }, 0.0f, 1.5f);
+    measureMath("FastMath::expApprox", [](float x) { return FastMath::expApprox(x); }, -10.0f, 10.0f);
+    measureMath("std::exp", [](float x) { return std::exp(x); }, -10.0f, 10.0f);
+    measureMath("FastMath::sinApprox", [](float x) { return FastMath::sinApprox(x); }, -4.0f, 4.0f);
+    measureMath("std::sin", [](float x) { return std::sin(x); }, -4.0f, 4.0f);
+
+    // Voice::renderBlock is called once per control period.
+    std::vector<float> output(size_t(controlPeriod), 0.0f);
+    for (int engine = 0; engine < 2; ++engine) {
+        Voice voice;
+        double t = measure([&] {
+            prepareVoice(voice, rate, engine == 1, cutoffTable, controlPeriod);
+            for (int i = 0; i + controlPeriod <= n; i += controlPeriod) {
+                voice.renderBlock(noise.data() + i, output.data(), controlPeriod);
+            }
+            sink = output[0];
+        });
+        report(engine == 0 ? "Voice::renderBlock (BLIT)" : "Voice::renderBlock (PolyBLEP)",
+               "sample", n - n % controlPeriod, t);
+    }
+    {
+        Voice voice;
+        prepareVoice(voice, rate, false, cutoffTable, controlPeriod);
+        const int calls = n / controlPeriod;
+        double t = measure([&] {
+            for (int i = 0; i < calls; ++i) { voice.updateLFO(); }
+            sink = voice.period;
+        });
+        report("Voice::updateLFO", "call", calls, t);
+    }
+
+    // The cost of converting the parameters when a single parameter changes
+    // compared to when they all change, such as after loading a preset.
+    {
+        auto synth = std::make_unique<Synth>();
+        synth->allocateResources(sampleRate, 512);
+        float values[NUM_PARAMS];
+        std::copy(presetValues, presetValues + NUM_PARAMS, values);
+        values[ParamIndex::controlRate] = float(controlRate);
+        values[ParamIndex::oversampling] = float(oversampling);
+        const int calls = 10000;
+        double t = measure([&] {
+            for (int i = 0; i < calls; ++i) {
+                values[ParamIndex::filterFreq] = float(i % 100);
+                applyParameters(*synth, values, rate, paramBit(ParamIndex::filterFreq));
+            }
+        });
+        report("applyParameters (one)", "call", calls, t);
+
+        t = measure([&] {
+            for (int i = 0; i < calls; ++i) {
+                values[ParamIndex::filterFreq] = float(i % 100);
+                applyParameters(*synth, values, rate, ALL_PARAMS);
+            }
+        });
+        report("applyParameters (all)", "call", calls, t);
+        synth->deallocateResources();
+    }
+
+    // A note off followed by a note on, with all MAX_VOICES voices playing,
+    // so that every note on has to steal a voice. The time is per event.
+    for (int policy = 0; policy < 2; ++policy) {
+        auto synth = std::make_unique<Synth>();
+        synth->allocateResources(sampleRate, 512);
+        float values[NUM_PARAMS];
+        std::copy(presetValues, presetValues + NUM_PARAMS, values);
+        values[ParamIndex::polyMode] = 5.0f;  // Poly 128
+        applyParameters(*synth, values, rate, ALL_PARAMS);
+        synth->reset();
+        synth->stealPolicy.oldest = (policy == 1);
+
+        for (int i = 0; i < Synth::MAX_VOICES; ++i) {
+            synth->midiMessage(0x90, uint8_t(1 + i % 127), 100);
+        }
+        const int calls = 10000;
+        double t = measure([&] {
+            for (int i = 0; i < calls; ++i) {
+                uint8_t note = uint8_t(1 + i % 127);
+                synth->midiMessage(0x80, note, 0);
+                synth->midiMessage(0x90, note, 100);
+            }
+        });
+        report(policy == 0 ? "Synth::midiMessage (steal quietest)" : "Synth::midiMessage (steal oldest)",
+               "call", calls * 2, t);
+        synth->deallocateResources();
+    }
+}
+
+// Plays a high sawtooth with each oscillator engine and measures how much of
+// the output lies between the harmonics. A sawtooth only has energy at the
+// multiples of its frequency, so everything else is aliasing: harmonics above
+// the Nyquist frequency that folded back down. Each result is a comment line
+// with the aliasing in dB relative to the total energy, lower is better.
+static void runAliasingTest(std::ostream& out, double sampleRate)
+{
+    const int fftOrder = 16;
+    const int fftSize = 1 << fftOrder;
+
+    // Near C7, but with every harmonic exactly on an FFT bin, so that the
+    // window doesn't smear the harmonics into the bins around them.
+    const int binsPerHarmonic = int(std::round(2093.0 * fftSize / sampleRate));
+    const float period = float(fftSize) / float(binsPerHarmonic);
+
+    // A Blackman-Harris window keeps each harmonic within 4 bins on either
+    // side, and its side lobes are more than 90 dB down.
+    const int mainLobe = 4;
+
+    juce::dsp::FFT fft(fftOrder);
+    juce::dsp::WindowingFunction<float> window(size_t(fftSize),
+        juce::dsp::WindowingFunction<float>::blackmanHarris, false);
+    std::vector<float> frame(size_t(fftSize) * 2);
+
+    for (int engine = 0; engine < 2; ++engine) {
+        Oscillator osc;
+        osc.reset();
+        osc.period = period;
+
+        // The BLIT is an impulse train that the voice integrates into a
+        // sawtooth, see Voice::renderBlock. Skip the first half second,
+        // while the integrator settles.
+        float saw = 0.0f;
+        const int warmUp = int(sampleRate / 2.0);
+        std::fill(frame.begin(), frame.end(), 0.0f);
+        for (int i = -warmUp; i < fftSize; ++i) {
+            float sample;
+            if (engine == 1) {
+                sample = osc.nextSawtooth();
+            } else {
+                saw = saw * 0.997f + osc.nextSample();
+                sample = saw;
+            }
+            if (i >= 0) { frame[size_t(i)] = sample; }
+        }
+        window.multiplyWithWindowingTable(frame.data(), size_t(fftSize));
+        fft.performFrequencyOnlyForwardTransform(frame.data());
+
+        // Bin 0 is the DC offset, which isn't a harmonic or aliasing.
+        double total = 0.0;
+        double aliasing = 0.0;
+        for (int bin = mainLobe + 1; bin <= fftSize / 2; ++bin) {
+            double power = double(frame[size_t(bin)]) * double(frame[size_t(bin)]);
+            int distance = bin % binsPerHarmonic;
+            distance = std::min(distance, binsPerHarmonic - distance);
+            total += power;
+            if (distance > mainLobe) {
+                aliasing += power;
+            }
+        }
+
+        out << "# Aliasing (" << (engine == 0 ? "BLIT" : "PolyBLEP") << "), "
+            << juce::String(sampleRate * binsPerHarmonic / fftSize, 1) << " Hz at "
+            << sampleRate << " Hz: "
+            << juce::String(10.0 * std::log10(aliasing / total + 1e-30), 1) << " dB\n";
+    }
+}
+
+// Plays `notes` notes at once and measures Synth::render. The preset is
+// switched to the largest number of voices, so that no voices are stolen.
+static void runSynthBenchmark(std::ostream& out, const Preset& preset, double sampleRate,
+                              int blockSize, int notes, double seconds, int numThreads,
+                              int controlRate, int oversampling)
+{
+    auto synth = std::make_unique<Synth>();
+    synth->numWorkerThreads = numThreads;
+    synth->allocateResources(sampleRate, blockSize);
+
+    float values[NUM_PARAMS];
+    std::copy(preset.param, preset.param + NUM_PARAMS, values);
+    values[ParamIndex::polyMode] = 5.0f;  // Poly 128
+    values[ParamIndex::controlRate] = float(controlRate);
+    values[ParamIndex::oversampling] = float(oversampling);
+    applyParameters(*synth, values, float(sampleRate), ALL_PARAMS);
+    synth->reset();
+
+    for (int i = 0; i < notes; ++i) {
+        synth->midiMessage(0x90, uint8_t((48 + i * 5) % 128), 100);
+    }
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    float* outputBuffers[2] = { buffer.getWritePointer(0), buffer.getWritePointer(1) };
+
+    // Get past the attack, where the voices may still be silent.
+    int warmUp = int(0.1 * sampleRate);
+    for (int i = 0; i < warmUp; i += blockSize) {
+        synth->render(outputBuffers, blockSize);
+    }
+
+    int numBlocks = juce::jmax(1, int(seconds * sampleRate) / blockSize);
+    double totalVoices = 0.0;
+
+    double start = now();
+    for (int i = 0; i < numBlocks; ++i) {
+        synth->render(outputBuffers, blockSize);
+        totalVoices += synth->getNumActiveVoices();
+    }
+    double elapsed = now() - start;
+
+    sink = outputBuffers[0][0];
+    synth->deallocateResources();
+
+    writeResult(out, { "Synth::render", preset.name, sampleRate, blockSize, notes,
+                       totalVoices / numBlocks, "sample", double(numBlocks) * blockSize, elapsed });
+}
+
+// Plays 8 notes with a stream of continuous controllers, for each of the
+// MIDI Timing choices. The preset is the same as for Synth::render.
+static void runControllerFloodBenchmark(std::ostream& out, const Preset& preset, double sampleRate,
+                                        int blockSize, double seconds, int controlRate,
+                                        int oversampling)
+{
+    static const char* names[] = {
+        "EventScheduler (CC flood, exact)",
+        "EventScheduler (CC flood, 1 ms)",
+        "EventScheduler (CC flood, 3 ms)",
+        "EventScheduler (CC flood, 10 ms)",
+    };
+    const int notes = 8;
+
+    auto synth = std::make_unique<Synth>();
+    synth->allocateResources(sampleRate, blockSize);
+
+    float values[NUM_PARAMS];
+    std::copy(preset.param, preset.param + NUM_PARAMS, values);
+    values[ParamIndex::polyMode] = 5.0f;  // Poly 128
+    values[ParamIndex::controlRate] = float(controlRate);
+    values[ParamIndex::oversampling] = float(oversampling);
+    applyParameters(*synth, values, float(sampleRate), ALL_PARAMS);
+
+    // The MIDI for all the blocks is made up front. The three controllers
+    // are spread out over each millisecond, so they never arrive together.
+    int numBlocks = juce::jmax(1, int(seconds * sampleRate) / blockSize);
+    std::vector<juce::MidiBuffer> midi { size_t(numBlocks) };
+    const double interval = sampleRate / 1000.0;
+    for (int controller = 0; controller < 3; ++controller) {
+        for (double time = interval * controller / 3.0; time < double(numBlocks * blockSize);
+             time += interval) {
+            int value = int(64.0 + 63.0 * std::sin(time / sampleRate * 3.0));
+            uint8_t message[3] = { 0xB0, 0x01, uint8_t(value) };  // mod wheel
+            if (controller == 1) {
+                message[0] = 0xD0;  // channel pressure
+                message[1] = uint8_t(value);
+            } else if (controller == 2) {
+                message[0] = 0xE0;  // pitch bend
+                message[1] = 0;
+            }
+            int sample = int(time);
+            midi[size_t(sample / blockSize)].addEvent(message, controller == 1 ? 2 : 3,
+                                                      sample % blockSize);
+        }
+    }
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+
+    for (int choice = 0; choice < 4; ++choice) {
+        synth->reset();
+        for (int i = 0; i < notes; ++i) {
+            synth->midiMessage(0x90, uint8_t((48 + i * 5) % 128), 100);
+        }
+
+        EventScheduler scheduler;
+        scheduler.setTolerance(midiToleranceForChoice(choice, sampleRate));
+        auto events = std::make_unique<EventQueue>();
+        auto hostEvents = std::make_unique<EventQueue>();
+
+        double segments = 0.0;
+        double totalVoices = 0.0;
+        double start = now();
+        for (int i = 0; i < numBlocks; ++i) {
+            events->clear();
+            events->addMidi(midi[size_t(i)], *hostEvents);
+            segments += scheduler.process(*synth, *events, blockSize,
+                [&](int offset, int count) {
+                    float* outputBuffers[2] = {
+                        buffer.getWritePointer(0, offset),
+                        buffer.getWritePointer(1, offset),
+                    };
+                    synth->render(outputBuffers, count);
+                },
+                [&](const SynthEvent& event) {
+                    synth->handleEvent(event);
+                });
+            totalVoices += synth->getNumActiveVoices();
+        }
+        double elapsed = now() - start;
+        sink = buffer.getWritePointer(0)[0];
+
+        out << "# " << names[choice] << ": " << segments / numBlocks
+            << " segments per block of " << blockSize << "\n";
+        writeResult(out, { names[choice], preset.name, sampleRate, blockSize, notes,
+                           totalVoices / numBlocks, "sample", double(numBlocks) * blockSize,
+                           elapsed });
+    }
+
+    synth->deallocateResources();
+}
+
+// Plays 8 notes while the volume fader sweeps up and down, sending CC 7 a
+// thousand times per second, and once without the fader to compare. The
+// audio thread's part is timed per block. It uses HostChanges, the same code
+// as the plug-in's handleHostEvents, to keep the newest value. Then it
+// changes the synth's output level and queues the host notifications. The
+// message thread, which empties the queue 30 times per second, is not timed.
+// Reports the number of messages and host notifications, and the mean and
+// slowest block, as a comment line.
+static void runVolumeSweepBenchmark(std::ostream& out, const Preset& preset, double sampleRate,
+                                    int blockSize, double seconds, int controlRate,
+                                    int oversampling)
+{
+    static const char* names[] = {
+        "HostNotificationQueue (no CC 7)",
+        "HostNotificationQueue (CC 7 sweep)",
+    };
+    const int notes = 8;
+
+    auto synth = std::make_unique<Synth>();
+    synth->allocateResources(sampleRate, blockSize);
+
+    float values[NUM_PARAMS];
+    std::copy(preset.param, preset.param + NUM_PARAMS, values);
+    values[ParamIndex::polyMode] = 5.0f;  // Poly 128
+    values[ParamIndex::controlRate] = float(controlRate);
+    values[ParamIndex::oversampling] = float(oversampling);
+    applyParameters(*synth, values, float(sampleRate), ALL_PARAMS);
+
+    int numBlocks = juce::jmax(1, int(seconds * sampleRate) / blockSize);
+    std::vector<juce::MidiBuffer> midi { size_t(numBlocks) };
+    const double interval = sampleRate / 1000.0;
+    int numMessages = 0;
+    for (double time = 0.0; time < double(numBlocks * blockSize); time += interval) {
+        double phase = std::fmod(time / sampleRate, 2.0);  // up in 1 s, down in 1 s
+        int value = int(127.0 * (phase < 1.0 ? phase : 2.0 - phase));
+        uint8_t message[3] = { 0xB0, 0x07, uint8_t(value) };
+        int sample = int(time);
+        midi[size_t(sample / blockSize)].addEvent(message, 3, sample % blockSize);
+        numMessages += 1;
+    }
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    float* outputBuffers[2] = { buffer.getWritePointer(0), buffer.getWritePointer(1) };
+    const int drainInterval = juce::jmax(1, int(sampleRate / 30.0) / blockSize);
+
+    for (int sweep = 0; sweep < 2; ++sweep) {
+        synth->reset();
+        for (int i = 0; i < notes; ++i) {
+            synth->midiMessage(0x90, uint8_t((48 + i * 5) % 128), 100);
+        }
+
+        auto events = std::make_unique<EventQueue>();
+        auto hostEvents = std::make_unique<EventQueue>();
+        auto notifications = std::make_unique<HostNotificationQueue>();
+        int numNotifications = 0;
+        double totalVoices = 0.0;
+        double elapsed = 0.0;
+        double slowest = 0.0;
+
+        for (int i = 0; i < numBlocks; ++i) {
+            double start = now();
+            events->clear();
+            hostEvents->clear();
+            if (sweep == 1) {
+                events->addMidi(midi[size_t(i)], *hostEvents);
+            }
+            HostChanges changes;
+            for (const SynthEvent& event : *hostEvents) {
+                changes.add(event, 0);
+            }
+            if (changes.changed != 0) {
+                // Output Level goes from -24 to +6 dB.
+                float volumeCtl = changes.normalized[ParamIndex::outputLevel];
+                values[ParamIndex::outputLevel] = -24.0f + 30.0f * volumeCtl;
+                applyParameters(*synth, values, float(sampleRate), changes.changed);
+            }
+            changes.notify(*notifications);
+            synth->render(outputBuffers, blockSize);
+            double time = now() - start;
+
+            elapsed += time;
+            slowest = juce::jmax(slowest, time);
+            totalVoices += synth->getNumActiveVoices();
+
+            if (i % drainInterval == drainInterval - 1 || i == numBlocks - 1) {
+                numNotifications += notifications->drain([](const HostNotification&) {});
+            }
+        }
+        sink = outputBuffers[0][0];
+
+        out << "# " << names[sweep] << ": " << (sweep == 1 ? numMessages : 0) << " messages, "
+            << numNotifications << " host notifications, block of " << blockSize
+            << " mean " << elapsed / numBlocks * 1e6 << " us, slowest " << slowest * 1e6
+            << " us\n";
+        writeResult(out, { names[sweep], preset.name, sampleRate, blockSize, notes,
+                           totalVoices / numBlocks, "sample", double(numBlocks) * blockSize,
+                           elapsed });
+    }
+
+    synth->deallocateResources();
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ArgumentList args(argc, argv);
+    if (args.containsOption("--help|-h")) {
+        std::cout << "Usage: JX11Bench [--out=results.csv] [--seconds=0.5] [--threads=0]\n"
+                  << "                 [--preset=N] [--rate=48000] [--block=512] [--micro-only]\n"
+                  << "                 [--control-rate=2] [--oversampling=0]\n"
+                  << "       JX11Bench --accuracy\n";
+        return 0;
+    }
+
+    if (args.containsOption("--accuracy")) {
+        return runAccuracyTest() == 0 ? 0 : 1;
+    }
+
+    double seconds = 0.5;
+    if (args.containsOption("--seconds")) {
+        seconds = args.getValueForOption("--seconds").getDoubleValue();
+    }
+
+    int numThreads = 0;
+    if (args.containsOption("--threads")) {
+        numThreads = juce::jmax(0, args.getValueForOption("--threads").getIntValue());
+    }
+
+    // Index of the Control Rate choice, the default is 32 samples.
+    int controlRate = 2;
+    if (args.containsOption("--control-rate")) {
+        controlRate = juce::jlimit(0, 6, args.getValueForOption("--control-rate").getIntValue());
+    }
+
+    // Index of the Oversampling choice, the default is off.
+    int oversampling = 0;
+    if (args.containsOption("--oversampling")) {
+        oversampling = juce::jlimit(0, 2, args.getValueForOption("--oversampling").getIntValue());
+    }
+
+    std::vector<Preset> presets;
+    createFactoryPresets(presets);
+
+    std::vector<int> presetIndices;
+    if (args.containsOption("--preset")) {
+        int index = args.getValueForOption("--preset").getIntValue();
+        if (index < 0 || index >= int(presets.size())) {
+            std::cerr << "Preset must be between 0 and " << presets.size() - 1 << "\n";
+            return 1;
+        }
+        presetIndices.push_back(index);
+    } else {
+        for (int i = 0; i < int(presets.size()); ++i) { presetIndices.push_back(i); }
+    }
+
+    std::vector<double> sampleRates { 44100.0, 48000.0, 96000.0, 192000.0 };
+    if (args.containsOption("--rate")) {
+        sampleRates = { args.getValueForOption("--rate").getDoubleValue() };
+    }
+
+    std::vector<int> blockSizes { 16, 32, 64, 128, 256, 512, 1024, 2048 };
+    if (args.containsOption("--block")) {
+        blockSizes = { args.getValueForOption("--block").getIntValue() };
+    }
+
+    std::ofstream file;
+    if (args.containsOption("--out")) {
+        file.open(args.getFileForOption("--out").getFullPathName().toStdString());
+        if (!file) {
+            std::cerr << "Cannot write to " << args.getValueForOption("--out") << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = file.is_open() ? file : std::cout;
+
+    cpuHz = juce::SystemStats::getCpuSpeedInMegahertz() * 1e6;
+
+    // Describe the machine, so that results from different runs can be told
+    // apart. CSV readers can skip these lines as comments.
+    out << "# cpu: " << juce::SystemStats::getCpuModel() << "\n";
+    out << "# cpuMHz: " << juce::SystemStats::getCpuSpeedInMegahertz() << "\n";
+    out << "# os: " << juce::SystemStats::getOperatingSystemName() << "\n";
+    out << "# simdLanes: " << VoiceBank::LANES << "\n";
+    out << "# workerThreads: " << numThreads << "\n";
+    out << "# controlRate: " << controlRate << "\n";
+    out << "# oversampling: " << oversampling << "\n";
+    writeHeader(out);
+
+    juce::ScopedNoDenormals noDenormals;
+
+    for (double sampleRate : sampleRates) {
+        runMicroBenchmarks(out, sampleRate, presets[0].param, controlRate, oversampling);
+        runAliasingTest(out, sampleRate);
+    }
+
+    if (args.containsOption("--micro-only")) {
+        return 0;
+    }
+
+    for (double sampleRate : sampleRates) {
+        for (int blockSize : blockSizes) {
+            runControllerFloodBenchmark(out, presets[size_t(presetIndices[0])], sampleRate,
+                                        blockSize, seconds, controlRate, oversampling);
+            runVolumeSweepBenchmark(out, presets[size_t(presetIndices[0])], sampleRate,
+                                    blockSize, seconds, controlRate, oversampling);
+        }
+    }
+
+    const int noteCounts[] = { 0, 1, 8, Synth::MAX_VOICES };
+    for (int index : presetIndices) {
+        for (double sampleRate : sampleRates) {
+            for (int blockSize : blockSizes) {
+                for (int notes : noteCounts) {
+                    runSynthBenchmark(out, presets[size_t(index)], sampleRate,
+                                      blockSize, notes, seconds, numThreads, controlRate,
+                                      oversampling);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include "GoldenTest.h"
+#include "OfflineRenderer.h"
+#include <iostream>
+
+// The references are always rendered with these settings, so that they stay
+// valid when the defaults of the command-line options change.
+static const double SAMPLE_RATE = 48000.0;
+static const int BLOCK_SIZE = 512;
+static const double LENGTH = 1.25;  // seconds, including the release
+
+static void addNote(juce::MidiMessageSequence& sequence, int note, double start, double end,
+                    int velocity = 100)
+{
+    sequence.addEvent(juce::MidiMessage::noteOn(1, note, uint8_t(velocity)), start);
+    sequence.addEvent(juce::MidiMessage::noteOff(1, note), end);
+}
+
+static void createChords(juce::MidiMessageSequence& sequence)
+{
+    for (int note : { 48, 52, 55, 60 }) {
+        addNote(sequence, note, 0.0, 0.5, 100);
+    }
+    for (int note : { 53, 57, 60, 65 }) {
+        addNote(sequence, note, 0.5, 0.9, 70);
+    }
+}
+
+static void createMonoLegato(juce::MidiMessageSequence& sequence)
+{
+    // The notes overlap, so the synth glides from one to the next.
+    const int notes[] = { 48, 55, 60, 67, 60, 55 };
+    for (int i = 0; i < 6; ++i) {
+        addNote(sequence, notes[i], i * 0.15, i * 0.15 + 0.2);
+    }
+}
+
+static void createSustainPedal(juce::MidiMessageSequence& sequence)
+{
+    sequence.addEvent(juce::MidiMessage::controllerEvent(1, 0x40, 127), 0.0);
+    addNote(sequence, 60, 0.0, 0.1);
+    addNote(sequence, 64, 0.2, 0.3);
+    addNote(sequence, 67, 0.4, 0.5);
+    addNote(sequence, 60, 0.6, 0.7);  // note that is already sustained
+    sequence.addEvent(juce::MidiMessage::controllerEvent(1, 0x40, 0), 0.8);
+}
+
+static void createPitchBend(juce::MidiMessageSequence& sequence)
+{
+    // Bend all the way up, all the way down, and back to the center.
+    addNote(sequence, 57, 0.0, 0.9);
+    for (int i = 0; i <= 40; ++i) {
+        double bend = std::sin(double(i) / 40.0 * juce::MathConstants<double>::twoPi);
+        int value = juce::jlimit(0, 16383, 8192 + int(8191.0 * bend));
+        sequence.addEvent(juce::MidiMessage::pitchWheel(1, value), 0.05 + i * 0.02);
+    }
+}
+
+static void createModWheel(juce::MidiMessageSequence& sequence)
+{
+    addNote(sequence, 60, 0.0, 0.9);
+    addNote(sequence, 64, 0.0, 0.9);
+    for (int i = 0; i <= 32; ++i) {
+        int value = (i <= 16) ? i * 127 / 16 : (32 - i) * 127 / 16;
+        sequence.addEvent(juce::MidiMessage::controllerEvent(1, 0x01, value), 0.05 + i * 0.025);
+    }
+}
+
+static void createAftertouch(juce::MidiMessageSequence& sequence)
+{
+    addNote(sequence, 55, 0.0, 0.9);
+    addNote(sequence, 62, 0.0, 0.9);
+    for (int i = 0; i <= 32; ++i) {
+        int value = (i <= 16) ? i * 127 / 16 : (32 - i) * 127 / 16;
+        sequence.addEvent(juce::MidiMessage::channelPressureChange(1, value), 0.05 + i * 0.025);
+    }
+}
+
+struct Scenario
+{
+    const char* name;
+    void (*create)(juce::MidiMessageSequence& sequence);
+
+    // Play in mono mode with legato-style glide, whatever the preset says.
+    bool monoLegato;
+};
+
+static const Scenario scenarios[] = {
+    { "chords", createChords, false },
+    { "mono legato", createMonoLegato, true },
+    { "sustain pedal", createSustainPedal, false },
+    { "pitch bend", createPitchBend, false },
+    { "mod wheel", createModWheel, false },
+    { "aftertouch", createAftertouch, false },
+};
+
+// Largest difference between two samples in the buffers.
+static double maxSampleDifference(const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b)
+{
+    double maxDiff = 0.0;
+    for (int channel = 0; channel < a.getNumChannels(); ++channel) {
+        const float* x = a.getReadPointer(channel);
+        const float* y = b.getReadPointer(channel);
+        for (int i = 0; i < a.getNumSamples(); ++i) {
+            maxDiff = std::max(maxDiff, double(std::abs(x[i] - y[i])));
+        }
+    }
+    return maxDiff;
+}
+
+// Average power of the mono mix in third-octave bands from 20 Hz up to the
+// Nyquist frequency, in decibels.
+static std::vector<double> bandLevels(const juce::AudioBuffer<float>& buffer)
+{
+    const int fftOrder = 11;
+    const int fftSize = 1 << fftOrder;
+
+    juce::dsp::FFT fft(fftOrder);
+    juce::dsp::WindowingFunction<float> window(size_t(fftSize), juce::dsp::WindowingFunction<float>::hann, false);
+
+    std::vector<float> frame(size_t(fftSize) * 2);
+    std::vector<double> power(size_t(fftSize / 2 + 1), 0.0);
+
+    const float* left = buffer.getReadPointer(0);
+    const float* right = buffer.getReadPointer(1);
+    for (int start = 0; start + fftSize <= buffer.getNumSamples(); start += fftSize / 2) {
+        std::fill(frame.begin(), frame.end(), 0.0f);
+        for (int i = 0; i < fftSize; ++i) {
+            frame[size_t(i)] = 0.5f * (left[start + i] + right[start + i]);
+        }
+        window.multiplyWithWindowingTable(frame.data(), size_t(fftSize));
+        fft.performFrequencyOnlyForwardTransform(frame.data());
+        for (size_t bin = 0; bin < power.size(); ++bin) {
+            power[bin] += double(frame[bin]) * double(frame[bin]);
+        }
+    }
+
+    const double binWidth = SAMPLE_RATE / double(fftSize);
+    const double bandRatio = std::pow(2.0, 1.0 / 3.0);
+
+    std::vector<double> levels;
+    for (double low = 20.0; low < SAMPLE_RATE / 2.0; low *= bandRatio) {
+        double sum = 0.0;
+        for (size_t bin = 0; bin < power.size(); ++bin) {
+            double freq = double(bin) * binWidth;
+            if (freq >= low && freq < low * bandRatio) {
+                sum += power[bin];
+            }
+        }
+        levels.push_back(10.0 * std::log10(sum + 1e-20));
+    }
+    return levels;
+}
+
+// Largest difference in decibels between the band levels. Bands that are
+// more than 80 dB below the loudest band are ignored; there is only noise.
+static double maxSpectralDifference(const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b)
+{
+    std::vector<double> levelsA = bandLevels(a);
+    std::vector<double> levelsB = bandLevels(b);
+
+    double loudest = -200.0;
+    for (size_t i = 0; i < levelsA.size(); ++i) {
+        loudest = std::max(loudest, std::max(levelsA[i], levelsB[i]));
+    }
+
+    double maxDiff = 0.0;
+    for (size_t i = 0; i < levelsA.size(); ++i) {
+        if (std::max(levelsA[i], levelsB[i]) > loudest - 80.0) {
+            maxDiff = std::max(maxDiff, std::abs(levelsA[i] - levelsB[i]));
+        }
+    }
+    return maxDiff;
+}
+
+int runGoldenTest(const GoldenTestOptions& options)
+{
+    if (options.update && !options.directory.createDirectory()) {
+        std::cerr << "Cannot create " << options.directory.getFullPathName() << "\n";
+        return 1;
+    }
+
+    // Without references the test would pass without checking anything,
+    // so it's an error. The Release post-build step only runs the test if
+    // the folder exists, and says it skipped it otherwise.
+    if (!options.update && !options.directory.isDirectory()) {
+        std::cerr << "No references in " << options.directory.getFullPathName() << "\n"
+                  << "Render them with --update from a build that is known to sound right.\n";
+        return 1;
+    }
+
+    std::vector<Preset> presets;
+    createFactoryPresets(presets);
+
+    OfflineRenderer renderer(SAMPLE_RATE, BLOCK_SIZE, options.numWorkerThreads);
+    juce::AudioBuffer<float> output(2, int(LENGTH * SAMPLE_RATE));
+    juce::AudioBuffer<float> reference;
+
+    int numFailed = 0;
+    int numRenders = 0;
+
+    for (size_t p = 0; p < presets.size(); ++p) {
+        for (const auto& scenario : scenarios) {
+            float values[NUM_PARAMS];
+            std::copy(presets[p].param, presets[p].param + NUM_PARAMS, values);
+            if (scenario.monoLegato) {
+                values[ParamIndex::polyMode] = 0.0f;
+                values[ParamIndex::glideMode] = 1.0f;
+            }
+
+            juce::MidiMessageSequence sequence;
+            scenario.create(sequence);
+            renderer.render(sequence, values, output);
+            numRenders += 1;
+
+            juce::String name = juce::String::formatted("%02d ", int(p)) + presets[p].name
+                              + " - " + scenario.name;
+            juce::File file = options.directory.getChildFile(
+                juce::String::formatted("%02d ", int(p)) + scenario.name + ".wav");
+
+            // Write the reference as 32-bit float so that it holds the exact
+            // output of the synth.
+            if (options.update) {
+                if (!writeWavFile(file, output, SAMPLE_RATE, 32)) {
+                    std::cerr << "Cannot write " << file.getFullPathName() << "\n";
+                    numFailed += 1;
+                }
+                continue;
+            }
+
+            double referenceRate = 0.0;
+            if (!readWavFile(file, reference, referenceRate)) {
+                std::cout << "MISSING " << name << "\n";
+                numFailed += 1;
+                continue;
+            }
+            if (referenceRate != SAMPLE_RATE || reference.getNumChannels() != 2
+                    || reference.getNumSamples() != output.getNumSamples()) {
+                std::cout << "FAIL    " << name << ": reference has a different format\n";
+                numFailed += 1;
+                continue;
+            }
+
+            double sampleDiff = maxSampleDifference(output, reference);
+            double spectralDiff = maxSpectralDifference(output, reference);
+            bool passed = sampleDiff <= options.sampleTolerance
+                       && spectralDiff <= options.spectralTolerance;
+            if (!passed) {
+                numFailed += 1;
+            }
+
+            std::cout << (passed ? "ok      " : "FAIL    ") << name
+                      << ": max sample diff " << juce::String(sampleDiff, 8)
+                      << ", max band diff " << juce::String(spectralDiff, 3) << " dB\n";
+        }
+    }
+
+    if (options.update) {
+        std::cout << "Wrote " << numRenders - numFailed << " references to "
+                  << options.directory.getFullPathName() << "\n";
+    } else {
+        std::cout << numRenders - numFailed << " of " << numRenders << " renders match the references\n";
+    }
+    return numFailed;
+}
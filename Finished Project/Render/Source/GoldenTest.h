@@ -0,0 +1,25 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Regression test for the sound of the synth. This renders every factory
+// preset with a fixed set of MIDI scenarios and compares the results with
+// reference renders that were made earlier with --update.
+//
+// Two things are checked. The largest difference between any two samples
+// must be below `sampleTolerance`. This catches any change, but it's also
+// very strict: the BLIT oscillators and the leaky integrator can drift in
+// phase from tiny rounding differences. So the spectra are compared too,
+// in third-octave bands, which must be within `spectralTolerance` decibels.
+// Loosen the sample tolerance to allow phase drift but not a change in tone.
+struct GoldenTestOptions
+{
+    juce::File directory;
+    bool update = false;
+    double sampleTolerance = 1e-4;
+    double spectralTolerance = 0.5;
+    int numWorkerThreads = 0;
+};
+
+// Returns the number of renders that did not match their reference.
+int runGoldenTest(const GoldenTestOptions& options);
@@ -0,0 +1,234 @@
+/*
+  ==============================================================================
+
+    JX11Render: renders a MIDI file through the JX11 synth without a DAW.
+
+    Usage:
+      JX11Render input.mid output.wav [--preset=N | --state=file]
+                 [--rate=48000] [--block=512] [--threads=N] [--tail=2]
+      JX11Render --golden=folder [--update] [--threads=N]
+                 [--sample-tolerance=0.0001] [--spectral-tolerance=0.5]
+
+    The state file is what the plug-in saves in getStateInformation, or the
+    XML version of that. It plays with the state's Quality choice, as in a
+    bounce from the host, so Auto renders with High. A factory preset plays
+    with Lean. The tool prints how much faster than realtime the synth
+    rendered, how many voices were playing or stolen, how long the blocks
+    took to render, and how often the output had to be silenced or clamped.
+
+    With --golden it renders all factory presets with a set of test
+    scenarios and compares them with the reference renders in the folder,
+    see GoldenTest.h. Use --update to write new references. The exit code
+    is 0 only if all renders match. The Release builds of this tool run
+    the test on the Golden folder next to the JX11 project after building.
+    The references are not in the repository, so when that folder doesn't
+    exist the build prints a loud "skipped" message instead of failing.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <iostream>
+#include "OfflineRenderer.h"
+#include "GoldenTest.h"
+
+static void printUsage()
+{
+    std::cout << "Usage: JX11Render input.mid output.wav [--preset=N | --state=file]\n"
+              << "                  [--rate=48000] [--block=512] [--threads=N] [--tail=2]\n"
+              << "       JX11Render --golden=folder [--update] [--threads=N]\n"
+              << "                  [--sample-tolerance=0.0001] [--spectral-tolerance=0.5]\n";
+}
+
+// Reads the parameter values and the Quality choice from a state file. The
+// plug-in stores its state as XML wrapped in a small binary header, but plain
+// XML also works.
+static bool loadState(const juce::File& file, float* values, int& qualityChoice)
+{
+    std::unique_ptr<juce::XmlElement> xml = juce::parseXML(file);
+    if (xml == nullptr) {
+        juce::MemoryBlock data;
+        if (file.loadFileAsData(data)) {
+            xml = juce::AudioProcessor::getXmlFromBinary(data.getData(), int(data.getSize()));
+        }
+    }
+    if (xml == nullptr) {
+        return false;
+    }
+
+    // AudioProcessorValueTreeState writes a PARAM element for each parameter.
+    // Parameters that are missing keep the value from the first preset.
+    for (auto* child : xml->getChildWithTagNameIterator("PARAM")) {
+        for (int i = 0; i < NUM_PARAMS; ++i) {
+            if (child->getStringAttribute("id") == getParameterID(i).getParamID()) {
+                values[i] = float(child->getDoubleAttribute("value", values[i]));
+            }
+        }
+        if (child->getStringAttribute("id") == ParameterID::quality.getParamID()) {
+            qualityChoice = juce::roundToInt(child->getDoubleAttribute("value", qualityChoice));
+        }
+    }
+    return true;
+}
+
+static void loadPreset(const Preset& preset, float* values)
+{
+    for (int i = 0; i < NUM_PARAMS; ++i) {
+        values[i] = preset.param[i];
+    }
+}
+
+// Returns the time in seconds for the given percentile of the block times.
+static double percentile(const std::vector<double>& sortedTimes, double p)
+{
+    if (sortedTimes.empty()) { return 0.0; }
+    size_t index = size_t(p / 100.0 * double(sortedTimes.size() - 1) + 0.5);
+    return sortedTimes[index];
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ArgumentList args(argc, argv);
+    if (args.containsOption("--help|-h")) {
+        printUsage();
+        return 0;
+    }
+
+    // No helper threads unless --threads asks for them, just like the
+    // plug-in, where the Worker Threads parameter is Off by default.
+    int numWorkerThreads = 0;
+    if (args.containsOption("--threads")) {
+        numWorkerThreads = juce::jmax(0, args.getValueForOption("--threads").getIntValue());
+    }
+
+    if (args.containsOption("--golden")) {
+        GoldenTestOptions options;
+        options.directory = args.getFileForOption("--golden");
+        options.update = args.containsOption("--update");
+        options.numWorkerThreads = numWorkerThreads;
+        if (args.containsOption("--sample-tolerance")) {
+            options.sampleTolerance = args.getValueForOption("--sample-tolerance").getDoubleValue();
+        }
+        if (args.containsOption("--spectral-tolerance")) {
+            options.spectralTolerance = args.getValueForOption("--spectral-tolerance").getDoubleValue();
+        }
+        return (runGoldenTest(options) == 0) ? 0 : 1;
+    }
+
+    if (args.size() < 2) {
+        printUsage();
+        return 1;
+    }
+
+    juce::File midiFileName = args[0].resolveAsFile();
+    juce::File outputFileName = args[1].resolveAsFile();
+
+    double sampleRate = 48000.0;
+    if (args.containsOption("--rate")) {
+        sampleRate = args.getValueForOption("--rate").getDoubleValue();
+    }
+
+    int blockSize = 512;
+    if (args.containsOption("--block")) {
+        blockSize = args.getValueForOption("--block").getIntValue();
+    }
+
+    double tail = 2.0;
+    if (args.containsOption("--tail")) {
+        tail = args.getValueForOption("--tail").getDoubleValue();
+    }
+
+    if (sampleRate <= 0.0 || blockSize <= 0 || tail < 0.0) {
+        printUsage();
+        return 1;
+    }
+
+    // Load the sound, either one of the factory presets or a saved state.
+    std::vector<Preset> presets;
+    createFactoryPresets(presets);
+
+    float values[NUM_PARAMS];
+    loadPreset(presets[0], values);
+
+    // A factory preset plays with Lean, so that it sounds the way it was
+    // made. A saved state plays with its Quality choice, for which this is
+    // offline rendering, so Auto picks High, just like a bounce in the host.
+    int qualityChoice = 1;
+
+    if (args.containsOption("--state")) {
+        qualityChoice = 0;
+        juce::File stateFile = args.getFileForOption("--state");
+        if (!loadState(stateFile, values, qualityChoice)) {
+            std::cerr << "Cannot read state file " << stateFile.getFullPathName() << "\n";
+            return 1;
+        }
+    } else if (args.containsOption("--preset")) {
+        int index = args.getValueForOption("--preset").getIntValue();
+        if (index < 0 || index >= int(presets.size())) {
+            std::cerr << "Preset must be between 0 and " << presets.size() - 1 << "\n";
+            return 1;
+        }
+        loadPreset(presets[size_t(index)], values);
+    }
+
+    // Merge all the tracks from the MIDI file into a single sequence.
+    juce::MidiFile midiFile;
+    juce::FileInputStream midiStream(midiFileName);
+    if (!midiStream.openedOk() || !midiFile.readFrom(midiStream)) {
+        std::cerr << "Cannot read MIDI file " << midiFileName.getFullPathName() << "\n";
+        return 1;
+    }
+    midiFile.convertTimestampTicksToSeconds();
+
+    juce::MidiMessageSequence sequence;
+    for (int track = 0; track < midiFile.getNumTracks(); ++track) {
+        sequence.addSequence(*midiFile.getTrack(track), 0.0);
+    }
+    sequence.sort();
+
+    int totalSamples = int(std::ceil((sequence.getEndTime() + tail) * sampleRate));
+    if (totalSamples <= 0) {
+        std::cerr << "Nothing to render\n";
+        return 1;
+    }
+
+    OfflineRenderer renderer(sampleRate, blockSize, numWorkerThreads);
+    renderer.quality = qualityProfileForChoice(qualityChoice, true);
+    juce::AudioBuffer<float> output(2, totalSamples);
+    renderer.render(sequence, values, output);
+
+    if (!writeWavFile(outputFileName, output, sampleRate, 24)) {
+        std::cerr << "Cannot write to " << outputFileName.getFullPathName() << "\n";
+        return 1;
+    }
+
+    // Print the report. A block must render in less than `budget` seconds,
+    // otherwise the plug-in would drop out at this block size.
+    double audioTime = double(totalSamples) / sampleRate;
+    double budget = double(blockSize) / sampleRate;
+    double renderTime = renderer.renderTime;
+    std::vector<double> blockTimes = renderer.blockTimes;
+    std::sort(blockTimes.begin(), blockTimes.end());
+
+    auto ms = [](double seconds) { return juce::String(seconds * 1000.0, 3) + " ms"; };
+
+    std::cout << "Rendered " << juce::String(audioTime, 2) << " s of audio in "
+              << juce::String(renderTime, 3) << " s ("
+              << juce::String(audioTime / renderTime, 1) << "x realtime)\n";
+    std::cout << "Worker threads: " << numWorkerThreads << "\n";
+    std::cout << "Voices: peak " << renderer.peakVoices << ", average "
+              << juce::String(renderer.averageVoices, 1) << ", "
+              << renderer.stolenVoices << " stolen\n";
+    std::cout << "MIDI: " << renderer.ignoredMessages << " messages ignored\n";
+    std::cout << "Output protection: " << renderer.silencedBuffers << " buffers silenced, "
+              << renderer.clampedBuffers << " clamped\n";
+    std::cout << "Block time (" << blockTimes.size() << " blocks of " << blockSize
+              << " samples, budget " << ms(budget) << "):\n";
+    std::cout << "  min    " << ms(blockTimes.front()) << "\n";
+    std::cout << "  median " << ms(percentile(blockTimes, 50.0)) << "\n";
+    std::cout << "  p90    " << ms(percentile(blockTimes, 90.0)) << "\n";
+    std::cout << "  p99    " << ms(percentile(blockTimes, 99.0)) << "\n";
+    std::cout << "  max    " << ms(blockTimes.back()) << "\n";
+
+    return 0;
+}
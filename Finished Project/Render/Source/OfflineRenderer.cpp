@@ -0,0 +1,157 @@
+#include "OfflineRenderer.h"
+
+OfflineRenderer::OfflineRenderer(double sampleRate_, int blockSize_, int numWorkerThreads_)
+    : sampleRate(sampleRate_), blockSize(blockSize_), numWorkerThreads(numWorkerThreads_)
+{
+    createFactoryPresets(presets);
+}
+
+void OfflineRenderer::render(const juce::MidiMessageSequence& sequence, const float* startValues,
+                             juce::AudioBuffer<float>& output)
+{
+    std::copy(startValues, startValues + NUM_PARAMS, values);
+
+    // Set up the synth in the same way as the plug-in's prepareToPlay. The
+    // synth is big, so don't put it on the stack.
+    auto synth = std::make_unique<Synth>();
+    synth->numWorkerThreads = numWorkerThreads;
+    synth->allocateResources(sampleRate, blockSize);
+    applyQualityProfile(*synth, quality, values);
+    applyParameters(*synth, values, float(sampleRate), ALL_PARAMS);
+    synth->reset();
+
+    output.clear();
+    const int totalSamples = output.getNumSamples();
+
+    blockTimes.clear();
+    blockTimes.reserve(size_t(totalSamples / blockSize + 1));
+    renderTime = 0.0;
+    peakVoices = 0;
+    stolenVoices = 0;
+    ignoredMessages = 0;
+    double totalVoices = 0.0;
+
+    juce::ScopedNoDenormals noDenormals;
+
+    int nextEvent = 0;
+    for (int blockStart = 0; blockStart < totalSamples; blockStart += blockSize) {
+        int blockEnd = juce::jmin(blockStart + blockSize, totalSamples);
+        auto startTicks = juce::Time::getHighResolutionTicks();
+
+        // Just like splitBufferByEvents, render up to the next MIDI event,
+        // handle the event, and then continue rendering.
+        int offset = blockStart;
+        while (offset < blockEnd) {
+            int segmentEnd = blockEnd;
+            while (nextEvent < sequence.getNumEvents()) {
+                const auto& message = sequence.getEventPointer(nextEvent)->message;
+                int position = int(message.getTimeStamp() * sampleRate);
+                if (position > offset) {
+                    segmentEnd = juce::jmin(position, blockEnd);
+                    break;
+                }
+                nextEvent += 1;
+
+                // Meta events only belong to the file. Count the messages
+                // that the synth doesn't use, such as sysex, like the plug-in.
+                if (message.isMetaEvent()) {
+                    continue;
+                }
+                SynthEvent event;
+                if (!SynthEvent::decode(message.getRawData(), message.getRawDataSize(), 0, event)) {
+                    ignoredMessages += 1;
+                    continue;
+                }
+
+                const uint8_t* data = message.getRawData();
+                uint8_t data1 = (message.getRawDataSize() >= 2) ? data[1] : 0;
+                uint8_t data2 = (message.getRawDataSize() == 3) ? data[2] : 0;
+                handleMIDI(*synth, data[0], data1, data2);
+            }
+
+            float* outputBuffers[2] = {
+                output.getWritePointer(0, offset),
+                output.getWritePointer(1, offset),
+            };
+            synth->render(outputBuffers, segmentEnd - offset);
+            offset = segmentEnd;
+        }
+
+        auto endTicks = juce::Time::getHighResolutionTicks();
+        double seconds = juce::Time::highResolutionTicksToSeconds(endTicks - startTicks);
+        blockTimes.push_back(seconds);
+        renderTime += seconds;
+
+        int activeVoices = synth->getNumActiveVoices();
+        peakVoices = juce::jmax(peakVoices, activeVoices);
+        totalVoices += activeVoices;
+
+        // The plug-in empties the telemetry on a background thread. Here it
+        // can simply be done after every block.
+        TelemetryRecord record;
+        while (synth->telemetry.pop(record)) {
+            if (record.event == TelemetryEvent::voiceStolen) {
+                stolenVoices += 1;
+            }
+        }
+    }
+
+    averageVoices = blockTimes.empty() ? 0.0 : totalVoices / double(blockTimes.size());
+    silencedBuffers = int(synth->outputProtection.nan + synth->outputProtection.inf
+                          + synth->outputProtection.tooLoud);
+    clampedBuffers = int(synth->outputProtection.clamped);
+    synth->deallocateResources();
+}
+
+void OfflineRenderer::handleMIDI(Synth& synth, uint8_t data0, uint8_t data1, uint8_t data2)
+{
+    // The plug-in maps these messages to parameter changes.
+    if ((data0 & 0xF0) == 0xB0 && data1 == 0x07) {
+        float volumeCtl = float(data2) / 127.0f;
+        values[ParamIndex::outputLevel] =
+            juce::NormalisableRange<float>(-24.0f, 6.0f, 0.1f).convertFrom0to1(volumeCtl);
+        applyParameters(synth, values, float(sampleRate), paramBit(ParamIndex::outputLevel));
+    }
+    if ((data0 & 0xF0) == 0xC0 && size_t(data1) < presets.size()) {
+        std::copy(presets[data1].param, presets[data1].param + NUM_PARAMS, values);
+        applyQualityProfile(synth, quality, values);
+        applyParameters(synth, values, float(sampleRate), ALL_PARAMS);
+        synth.reset();
+    }
+
+    synth.midiMessage(data0, data1, data2);
+}
+
+bool writeWavFile(const juce::File& file, const juce::AudioBuffer<float>& buffer,
+                  double sampleRate, int bitsPerSample)
+{
+    file.deleteFile();
+    auto stream = std::make_unique<juce::FileOutputStream>(file);
+    if (!stream->openedOk()) {
+        return false;
+    }
+
+    juce::WavAudioFormat wavFormat;
+    std::unique_ptr<juce::AudioFormatWriter> writer(wavFormat.createWriterFor(
+        stream.get(), sampleRate, unsigned(buffer.getNumChannels()), bitsPerSample, {}, 0));
+    if (writer == nullptr) {
+        return false;
+    }
+    stream.release();  // the writer owns the stream now
+
+    return writer->writeFromAudioSampleBuffer(buffer, 0, buffer.getNumSamples());
+}
+
+bool readWavFile(const juce::File& file, juce::AudioBuffer<float>& buffer, double& sampleRate)
+{
+    juce::WavAudioFormat wavFormat;
+    std::unique_ptr<juce::AudioFormatReader> reader(
+        wavFormat.createReaderFor(new juce::FileInputStream(file), true));
+    if (reader == nullptr) {
+        return false;
+    }
+
+    sampleRate = reader->sampleRate;
+    buffer.setSize(int(reader->numChannels), int(reader->lengthInSamples));
+    return reader->read(&buffer, 0, int(reader->lengthInSamples), 0, true, true);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "../../Source/Synth.h"
+#include "../../Source/ParameterMapping.h"
+
+// Plays a MIDI sequence through Synth, the same way the plug-in does in
+// processBlock, and measures how long every block takes.
+class OfflineRenderer
+{
+public:
+    OfflineRenderer(double sampleRate, int blockSize, int numWorkerThreads);
+
+    // Renders the sequence into the two channels of `output`, starting from
+    // a freshly reset synth. `values` are the parameter values to start with,
+    // in the same units as Preset::param.
+    void render(const juce::MidiMessageSequence& sequence, const float* values,
+                juce::AudioBuffer<float>& output);
+
+    // The quality profile that overrides some of the parameters, just like
+    // in the plug-in. Lean uses them as they are.
+    QualityProfile quality = QualityProfiles::lean;
+
+    // Measurements from the last call to render.
+    std::vector<double> blockTimes;
+    double renderTime = 0.0;
+    int peakVoices = 0;
+    double averageVoices = 0.0;
+    int stolenVoices = 0;
+    int ignoredMessages = 0;
+    int silencedBuffers = 0;
+    int clampedBuffers = 0;
+
+    const double sampleRate;
+    const int blockSize;
+    const int numWorkerThreads;
+
+private:
+    void handleMIDI(Synth& synth, uint8_t data0, uint8_t data1, uint8_t data2);
+
+    std::vector<Preset> presets;
+    float values[NUM_PARAMS];
+};
+
+// Writes the buffer to a WAV file. Returns false if this failed.
+bool writeWavFile(const juce::File& file, const juce::AudioBuffer<float>& buffer,
+                  double sampleRate, int bitsPerSample);
+
+// Reads a WAV file into the buffer. Returns false if this failed.
+bool readWavFile(const juce::File& file, juce::AudioBuffer<float>& buffer, double& sampleRate);
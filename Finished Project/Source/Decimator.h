@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Low-pass filter that halves the sample rate. A half-band filter has its
+// cutoff at exactly half the Nyquist frequency, which makes every other tap
+// zero, except the one in the middle. Only every other output sample is kept,
+// so only those are computed: this is the polyphase form. One branch is just
+// the middle tap, which is a delay and a gain of 0.5. The other branch is a
+// symmetric FIR filter, so each coefficient is used for two input samples.
+//
+// The coefficients are a windowed sinc, with a Kaiser window.
+class HalfBandDecimator
+{
+public:
+    // `numTaps` must be 4n + 3 so that the outermost taps are not zero. More
+    // taps give a steeper filter. `beta` is the Kaiser window's shape: larger
+    // values give more stopband attenuation but a wider transition band.
+    HalfBandDecimator(int numTaps_, double beta) : numTaps(numTaps_)
+    {
+        // The nonzero taps on one side of the middle tap, from the inside out.
+        const double PI = 3.1415926535897932;
+        const int middle = (numTaps - 1) / 2;
+        for (int i = 1; i <= middle; i += 2) {
+            double sinc = std::sin(PI * i / 2.0) / (PI * i);
+            double x = double(i) / double(middle);
+            double window = besselI0(beta * std::sqrt(1.0 - x * x)) / besselI0(beta);
+            coefficients.push_back(float(sinc * window));
+        }
+    }
+
+    // Makes room for blocks of up to `maxOutputSamples`. Don't call this
+    // from the audio thread.
+    void prepare(int maxOutputSamples)
+    {
+        buffer.resize(size_t(numTaps - 1 + 2 * maxOutputSamples));
+        reset();
+    }
+
+    void reset()
+    {
+        std::fill(buffer.begin(), buffer.end(), 0.0f);
+    }
+
+    // Filters `2 * outputCount` samples from `input` and writes every other
+    // one to `output`. Input and output may be the same buffer.
+    void process(const float* input, float* output, int outputCount)
+    {
+        // The buffer holds the last `numTaps - 1` input samples from the
+        // previous block, followed by the new ones.
+        const int history = numTaps - 1;
+        std::copy(input, input + 2 * outputCount, buffer.begin() + history);
+
+        const int numCoefficients = int(coefficients.size());
+        const int middle = history / 2;
+        for (int n = 0; n < outputCount; ++n) {
+            const float* x = buffer.data() + 2 * n + middle;
+            float sum = 0.5f * x[0];
+            for (int i = 0; i < numCoefficients; ++i) {
+                int offset = 2 * i + 1;
+                sum += coefficients[size_t(i)] * (x[-offset] + x[offset]);
+            }
+            output[n] = sum;
+        }
+
+        std::copy(buffer.begin() + 2 * outputCount, buffer.begin() + 2 * outputCount + history,
+                  buffer.begin());
+    }
+
+private:
+    // Modified Bessel function of the first kind, used by the Kaiser window.
+    static double besselI0(double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; k < 50; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    const int numTaps;
+    std::vector<float> coefficients;
+    std::vector<float> buffer;
+};
+
+// Brings one channel from the oversampled rate back down to the host's rate,
+// using one half-band stage for 2x oversampling and two for 4x.
+//
+// The last stage has to be steep. Up to 0.45 times the host's sample rate
+// (20 kHz at 44.1 kHz) the gain is flat within 0.002 dB. Anything above 0.55
+// times the host's sample rate would fold back to below that, so it's
+// attenuated by 80 dB. The first stage of 4x oversampling only needs to
+// remove what would fold into the passband, which takes far fewer taps. The
+// delay is 27.5 samples at the host's rate for 2x oversampling and 30.25
+// samples for 4x.
+class Decimator
+{
+public:
+    static constexpr int MAX_FACTOR = 4;
+
+    // After this many output samples of silence, only zeros are left in the
+    // filters. The last stage remembers 110 samples at twice the host's rate
+    // and the first stage 22 samples at four times the host's rate.
+    static constexpr int FLUSH_SAMPLES = 64;
+
+    // The delay for the factor, in samples at the host's rate, rounded to a
+    // whole sample so that the host can make up for it. A symmetric filter
+    // delays by half its length, at the rate it runs at.
+    static int getLatency(int factor)
+    {
+        double delay = 0.0;
+        if (factor >= 2) { delay += double(LAST_STAGE_TAPS - 1) / 4.0; }
+        if (factor == 4) { delay += double(FIRST_STAGE_TAPS - 1) / 8.0; }
+        return int(std::lround(delay));
+    }
+
+    void prepare(int maxOutputSamples)
+    {
+        firstStage.prepare(maxOutputSamples * 2);
+        lastStage.prepare(maxOutputSamples);
+    }
+
+    void reset()
+    {
+        firstStage.reset();
+        lastStage.reset();
+    }
+
+    // Reads `factor * outputCount` samples from `input` and writes
+    // `outputCount` samples to `output`. The factor must be 1, 2 or 4. This
+    // overwrites `input`, which may also be the same buffer as `output`.
+    void process(float* input, float* output, int outputCount, int factor)
+    {
+        if (factor == 4) {
+            firstStage.process(input, input, outputCount * 2);
+            lastStage.process(input, output, outputCount);
+        } else if (factor == 2) {
+            lastStage.process(input, output, outputCount);
+        } else if (input != output) {
+            std::copy(input, input + outputCount, output);
+        }
+    }
+
+private:
+    static constexpr int FIRST_STAGE_TAPS = 23;
+    static constexpr int LAST_STAGE_TAPS = 111;
+
+    HalfBandDecimator firstStage { FIRST_STAGE_TAPS, 8.0 };
+    HalfBandDecimator lastStage { LAST_STAGE_TAPS, 8.0 };
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cmath>
+
 const float SILENCE = 0.0001f;  // voice choking
 
 // Analog style envelope generator.
@@ -59,6 +61,17 @@ public:
         multiplier = releaseMultiplier;
     }
 
+    // Keeps the envelope's timing the same when it runs at a different
+    // sample rate. `ratio` is the new rate divided by the old one.
+    void changeSampleRate(float ratio)
+    {
+        float exponent = 1.0f / ratio;
+        attackMultiplier = std::pow(attackMultiplier, exponent);
+        decayMultiplier = std::pow(decayMultiplier, exponent);
+        releaseMultiplier = std::pow(releaseMultiplier, exponent);
+        multiplier = std::pow(multiplier, exponent);
+    }
+
     // Parameter values for this envelope.
     float attackMultiplier;
     float decayMultiplier;
@@ -69,6 +82,8 @@ public:
     float level;
 
 private:
+    friend class VoiceBank;
+
     float target;
     float multiplier;
 };
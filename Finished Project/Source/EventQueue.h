@@ -0,0 +1,154 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+
+// A MIDI message after it has been decoded, so that the synth doesn't need
+// to look at the raw bytes again. The synth responds to all MIDI channels in
+// the same way, so the channel is not kept.
+struct SynthEvent
+{
+    enum class Type : uint8_t
+    {
+        noteOn,         // number: note, value: velocity from 1 to 127
+        noteOff,        // number: note
+        controlChange,  // number: controller, value: 0 - 127
+        pressure,       // value: 0 - 127
+        pitchBend,      // value: -8192 to 8191
+        programChange,  // number: program
+    };
+
+    Type type;
+    uint8_t number;
+    int16_t value;
+
+    // The sample in the block where the event happens.
+    int position;
+
+    // Decodes a MIDI message of up to 3 bytes. Returns false for messages
+    // that the synth doesn't use, such as sysex, poly pressure and clock.
+    static bool decode(const uint8_t* data, int numBytes, int position, SynthEvent& event)
+    {
+        if (numBytes < 1 || numBytes > 3) { return false; }
+
+        uint8_t data1 = (numBytes >= 2) ? (data[1] & 0x7F) : 0;
+        uint8_t data2 = (numBytes == 3) ? (data[2] & 0x7F) : 0;
+        event.number = data1;
+        event.value = 0;
+        event.position = position;
+
+        switch (data[0] & 0xF0) {
+            case 0x80:
+                event.type = Type::noteOff;
+                return true;
+
+            // A note on with velocity 0 is a note off.
+            case 0x90:
+                event.type = (data2 > 0) ? Type::noteOn : Type::noteOff;
+                event.value = data2;
+                return true;
+
+            case 0xB0:
+                event.type = Type::controlChange;
+                event.value = data2;
+                return true;
+
+            case 0xC0:
+                event.type = Type::programChange;
+                return true;
+
+            case 0xD0:
+                event.type = Type::pressure;
+                event.number = 0;
+                event.value = data1;
+                return true;
+
+            case 0xE0:
+                event.type = Type::pitchBend;
+                event.number = 0;
+                event.value = int16_t(data1 + 128 * data2 - 8192);
+                return true;
+
+            default:
+                return false;
+        }
+    }
+
+    // Program changes and the volume controller change the plug-in's
+    // parameters, so they must go to the host instead of the synth.
+    bool isForHost() const
+    {
+        return type == Type::programChange
+            || (type == Type::controlChange && number == 0x07);
+    }
+};
+
+// The events for one block, sorted by their position. This has a fixed size,
+// so that filling it on the audio thread never allocates memory. Events that
+// don't fit are dropped and counted.
+class EventQueue
+{
+public:
+    static constexpr int CAPACITY = 2048;
+
+    void clear() { count = 0; }
+    bool isEmpty() const { return count == 0; }
+    int size() const { return count; }
+
+    const SynthEvent& operator[](int index) const { return events[size_t(index)]; }
+    const SynthEvent* begin() const { return events.data(); }
+    const SynthEvent* end() const { return events.data() + count; }
+
+    // Adds the event after all the events at the same or an earlier
+    // position. MIDI buffers are already sorted, so this normally appends.
+    void add(const SynthEvent& event)
+    {
+        if (count == CAPACITY) {
+            numDropped += 1;
+            return;
+        }
+        int index = count++;
+        while (index > 0 && events[size_t(index - 1)].position > event.position) {
+            events[size_t(index)] = events[size_t(index - 1)];
+            index -= 1;
+        }
+        events[size_t(index)] = event;
+    }
+
+    // Decodes the MIDI buffer into this queue and `hostEvents`, which gets
+    // the events for which SynthEvent::isForHost is true. Messages that the
+    // synth doesn't use are counted as ignored.
+    void addMidi(const juce::MidiBuffer& midiMessages, EventQueue& hostEvents)
+    {
+        addMidi(midiMessages, hostEvents, [](const SynthEvent& event) { return event.isForHost(); });
+    }
+
+    // The same, but `isForHost(event)` decides which events go to
+    // `hostEvents`, for example the controllers that are mapped to
+    // parameters.
+    template<typename Predicate>
+    void addMidi(const juce::MidiBuffer& midiMessages, EventQueue& hostEvents, Predicate&& isForHost)
+    {
+        for (const auto metadata : midiMessages) {
+            SynthEvent event;
+            if (!SynthEvent::decode(metadata.data, metadata.numBytes, metadata.samplePosition, event)) {
+                numIgnored += 1;
+            } else if (isForHost(event)) {
+                hostEvents.add(event);
+            } else {
+                add(event);
+            }
+        }
+    }
+
+    // Totals since the queue was created. The plug-in reports them as
+    // TelemetryEvent::midiLost.
+    uint32_t getNumDropped() const { return numDropped; }
+    uint32_t getNumIgnored() const { return numIgnored; }
+
+private:
+    std::array<SynthEvent, CAPACITY> events;
+    int count = 0;
+    uint32_t numDropped = 0;
+    uint32_t numIgnored = 0;
+};
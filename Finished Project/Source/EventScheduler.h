@@ -0,0 +1,182 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include "Synth.h"
+
+// Decides where a block of audio is split up for the MIDI events in it.
+//
+// Every MIDI event splits the block, because the synth is rendered up to the
+// event and then continues from there. A controller that sends the mod wheel,
+// aftertouch and pitch bend a thousand times per second turns a block of 512
+// samples into dozens of short segments, and each of those costs the setup at
+// the start of Synth::render.
+//
+// Note on and off, the sustain pedal, program changes and the other events
+// that aren't continuous still happen on the exact sample. Continuous
+// controllers (control changes, channel pressure and pitch bend) may be moved
+// later by up to `tolerance` samples. They are moved to the last control step
+// boundary in that window, where the synth updates the LFO and reads the
+// controllers, so that several of them end up in the same place. If there is
+// no boundary in the window, they are moved to the end of the window. When the
+// same controller changes more than once before that point, only its last
+// value is used.
+//
+// Apart from pitch bend, the synth only looks at these controllers at the
+// start of a control step. A change already had to wait for the next step
+// boundary, so with a tolerance shorter than the control period nothing but
+// pitch bend changes. With a longer tolerance, a change may skip some steps
+// and be heard up to `tolerance` samples later than before.
+//
+// The events are handled in their original order, except that a continuous
+// controller may be handled after the continuous controllers that follow it.
+// Before any other event, all the controllers that are waiting are handled.
+class EventScheduler
+{
+public:
+    // With a tolerance of 0, every event happens on its exact sample.
+    void setTolerance(int samples) { tolerance = std::max(samples, 0); }
+    int getTolerance() const { return tolerance; }
+
+    // Calls `render(offset, count)` for the parts of the block between the
+    // events and `handle(event)` for the events. `synth` is only used to find
+    // the control step boundaries, and must be the synth that `render`
+    // renders. Returns the number of times that `render` was called.
+    template<typename RenderFunction, typename EventFunction>
+    int process(const Synth& synth, const EventQueue& events, int sampleCount,
+                RenderFunction&& render, EventFunction&& handle)
+    {
+        int bufferOffset = 0;
+        int segments = 0;
+
+        auto renderUpTo = [&](int position) {
+            if (position > bufferOffset) {
+                render(bufferOffset, position - bufferOffset);
+                bufferOffset = position;
+                segments += 1;
+            }
+        };
+
+        for (const SynthEvent& event : events) {
+            int position = std::min(event.position, sampleCount);
+
+            // Handle the controllers that were waiting for this point.
+            if (numPending > 0 && flushPosition <= position) {
+                renderUpTo(flushPosition);
+                flush(handle);
+            }
+
+            int key = continuousKey(event);
+            if (tolerance > 0 && key >= 0) {
+                if (numPending == 0) {
+                    flushPosition = findFlushPosition(synth, bufferOffset, position);
+                }
+                addPending(key, event);
+            } else {
+                renderUpTo(position);
+                flush(handle);
+                handle(event);
+            }
+        }
+
+        // Controllers that would be handled in the next block are handled at
+        // the end of this one instead, which is still before they are used.
+        if (numPending > 0) {
+            renderUpTo(std::min(flushPosition, sampleCount));
+            flush(handle);
+        }
+        renderUpTo(sampleCount);
+        return segments;
+    }
+
+private:
+    // One slot for each control change number, then channel pressure and
+    // pitch bend. The synth responds to all MIDI channels in the same way,
+    // so the channel doesn't matter.
+    static constexpr int NUM_KEYS = 130;
+
+    // The slot for a continuous controller, or -1 for any other event. The
+    // sustain pedal and the channel mode messages from 0x78 up are not
+    // continuous.
+    static int continuousKey(const SynthEvent& event)
+    {
+        switch (event.type) {
+            case SynthEvent::Type::controlChange:
+                return (event.number == 0x40 || event.number >= 0x78) ? -1 : int(event.number);
+            case SynthEvent::Type::pressure: return 128;
+            case SynthEvent::Type::pitchBend: return 129;
+            default: return -1;
+        }
+    }
+
+    // The last control step boundary between `position` and `position +
+    // tolerance`, or the end of that window if it has no boundary. The synth
+    // must have been rendered up to `bufferOffset`. A controller that is
+    // handled on sample `h` is used by the control step that starts at the
+    // oversampled position `h * oversampling` or later.
+    int findFlushPosition(const Synth& synth, int bufferOffset, int position) const
+    {
+        const int oversampling = synth.getOversampling();
+        const int period = synth.controlPeriod;
+        const int next = synth.getSamplesUntilControlUpdate();
+        const int limit = position + tolerance;
+
+        // The boundary at the oversampled position `next + k * period` from
+        // `bufferOffset` belongs to sample `bufferOffset + (next + k * period)
+        // / oversampling`. Find the largest `k` for which that is <= limit.
+        int room = (limit - bufferOffset + 1) * oversampling - 1 - next;
+        if (room >= 0) {
+            int boundary = bufferOffset + (next + (room / period) * period) / oversampling;
+            if (boundary >= position) {
+                return boundary;
+            }
+        }
+        return limit;
+    }
+
+    // A controller that is already waiting moves to the end of the list.
+    // Different controllers may change the same setting, such as 0x4A and
+    // 0x4B for the filter, so the most recent one must be handled last.
+    void addPending(int key, const SynthEvent& event)
+    {
+        int index = pendingIndex[size_t(key)];
+        if (index >= 0) {
+            for (int i = index + 1; i < numPending; ++i) {
+                pending[size_t(i - 1)] = pending[size_t(i)];
+                pendingIndex[size_t(continuousKey(pending[size_t(i)]))] = int16_t(i - 1);
+            }
+            numPending -= 1;
+        }
+        pendingIndex[size_t(key)] = int16_t(numPending);
+        pending[size_t(numPending++)] = event;
+    }
+
+    template<typename EventFunction>
+    void flush(EventFunction&& handle)
+    {
+        for (int i = 0; i < numPending; ++i) {
+            const SynthEvent& event = pending[size_t(i)];
+            pendingIndex[size_t(continuousKey(event))] = -1;
+            handle(event);
+        }
+        numPending = 0;
+    }
+
+    int tolerance = 0;
+
+    // The controllers that are waiting, in the order they last changed, and
+    // where each controller is in that list, or -1.
+    std::array<SynthEvent, NUM_KEYS> pending;
+    std::array<int16_t, NUM_KEYS> pendingIndex = makeEmptyIndex();
+    int numPending = 0;
+
+    // The sample on which the waiting controllers are handled.
+    int flushPosition = 0;
+
+    static std::array<int16_t, NUM_KEYS> makeEmptyIndex()
+    {
+        std::array<int16_t, NUM_KEYS> index;
+        index.fill(-1);
+        return index;
+    }
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <cstring>
+
+// Set this to 0 to use the functions from the standard library everywhere
+// instead of the approximations.
+#ifndef JX11_FAST_MATH
+#define JX11_FAST_MATH 1
+#endif
+
+// Fast approximations for the transcendental functions that the synth needs
+// per voice: the cutoff modulation on every control step, the sine oscillator
+// at the start of every BLIT cycle, and the pitch, cutoff and panning on
+// every note-on.
+//
+// These are short polynomials after a simple range reduction. The SIMD
+// versions of exp2 and exp do exactly the same operations in the same order
+// as the scalar ones, so they give exactly the same results (unless the
+// compiler is allowed to fuse the multiplies and adds). The largest errors
+// over the input ranges below, compared to the double precision functions,
+// are:
+//
+//     exp2    x in [-32, 32]     1e-7 relative
+//     exp     x in [-20, 20]     1e-6 relative
+//     sin     x in [-100, 100]   3e-7 absolute
+//     cos     x in [-100, 100]   5e-7 absolute
+//     tan     x in [0, 1.5]      8e-7 relative
+//
+// Outside these ranges the results are wrong; there are no checks for this.
+// For the synth this means pitch and filter cutoff errors below 0.001 cents.
+// Run JX11Bench --accuracy to measure these.
+namespace FastMath
+{
+    using SIMD = juce::dsp::SIMDRegister<float>;
+
+    const float LOG2_E = 1.4426950408889634f;
+    const float HALF_PI = 1.5707963267948966f;
+    const float PI_F = 3.1415926535897932f;
+    const float INV_TWO_PI = 0.15915494309189535f;
+
+    // 2*PI split into two parts, so that x - k*2*PI loses less precision.
+    const float TWO_PI_HI = 6.28125f;
+    const float TWO_PI_LO = 0.0019353071795864769f;
+
+    // 2^f for f between -0.5 and 0.5. This is the Taylor series of e^(f ln 2).
+    template<typename T>
+    inline T exp2Polynomial(T f)
+    {
+        T p = f * 1.5252733804059841e-5f + 1.5403530393381610e-4f;
+        p = p * f + 1.3333558146428443e-3f;
+        p = p * f + 9.6181291076284772e-3f;
+        p = p * f + 5.5504108664821580e-2f;
+        p = p * f + 0.24022650695910071f;
+        p = p * f + 0.69314718055994531f;
+        return p * f + 1.0f;
+    }
+
+    // sin(x) for x between -PI/2 and PI/2. This is the Taylor series.
+    template<typename T>
+    inline T sinPolynomial(T x)
+    {
+        T x2 = x * x;
+        T p = x2 * -2.5052108385441720e-8f + 2.7557319223985893e-6f;
+        p = p * x2 - 1.9841269841269841e-4f;
+        p = p * x2 + 8.3333333333333333e-3f;
+        p = p * x2 - 0.16666666666666667f;
+        return (p * x2) * x + x;
+    }
+
+    // cos(x) for x between -PI/2 and PI/2. This is the Taylor series. Unlike
+    // sin(x + PI/2), this is accurate very close to 1, which matters for the
+    // oscillator's sine recursion.
+    template<typename T>
+    inline T cosPolynomial(T x)
+    {
+        T x2 = x * x;
+        T p = x2 * 2.0876756987868099e-9f - 2.7557319223985891e-7f;
+        p = p * x2 + 2.4801587301587302e-5f;
+        p = p * x2 - 1.3888888888888889e-3f;
+        p = p * x2 + 4.1666666666666667e-2f;
+        p = p * x2 - 0.5f;
+        return p * x2 + 1.0f;
+    }
+
+    inline float exp2Approx(float x)
+    {
+        // Split x into a whole number i and a fraction f between -0.5 and 0.5.
+        // Adding 32.5 makes the value positive, so that truncating rounds.
+        float i = float(int(x + 32.5f)) - 32.0f;
+        float f = x - i;
+
+        // 2^i is made by putting i directly into the float's exponent bits.
+        int32_t bits = (int32_t(i) + 127) << 23;
+        float scale;
+        std::memcpy(&scale, &bits, sizeof(float));
+
+        return exp2Polynomial(f) * scale;
+    }
+
+    inline float expApprox(float x)
+    {
+        return exp2Approx(x * LOG2_E);
+    }
+
+    // sin(r) for r between -PI and PI. Mirrors r around PI/2 or -PI/2 into
+    // the range of the polynomial.
+    inline float sinReduced(float r)
+    {
+        if (r > HALF_PI) {
+            r = PI_F - r;
+        } else if (r < -HALF_PI) {
+            r = -PI_F - r;
+        }
+        return sinPolynomial(r);
+    }
+
+    inline float sinApprox(float x)
+    {
+        // Subtract the nearest multiple of 2*PI to get x between -PI and PI.
+        float k = float(int(x * INV_TWO_PI + 32.5f)) - 32.0f;
+        float r = (x - k * TWO_PI_HI) - k * TWO_PI_LO;
+        return sinReduced(r);
+    }
+
+    inline float cosApprox(float x)
+    {
+        float k = float(int(x * INV_TWO_PI + 32.5f)) - 32.0f;
+        float r = std::abs((x - k * TWO_PI_HI) - k * TWO_PI_LO);
+
+        // cos(r) = -cos(PI - r) for r between PI/2 and PI.
+        if (r > HALF_PI) {
+            return -cosPolynomial(PI_F - r);
+        }
+        return cosPolynomial(r);
+    }
+
+    inline float tanApprox(float x)
+    {
+        return sinPolynomial(x) / sinPolynomial(HALF_PI - x);
+    }
+
+    // Picks the lanes from `a` where the mask is set, and from `b` otherwise.
+    inline SIMD select(SIMD::vMaskType mask, SIMD a, SIMD b)
+    {
+        return (a & mask) + (b & ~mask);
+    }
+
+    // SIMD versions of exp2 and exp, for the cutoff modulation of a group of
+    // voices. SIMDRegister has no float-to-int conversion, so 2^i is built up
+    // by multiplying powers of two, which are exact.
+    inline SIMD exp2Approx(SIMD x)
+    {
+        SIMD n = SIMD::truncate(x + 32.5f);  // i + 32, between 0 and 64
+        SIMD f = x - (n - 32.0f);
+
+        SIMD scale = SIMD::expand(2.3283064365386963e-10f);  // 2^-32
+        float bit = 64.0f;
+        float power = 1.8446744073709552e19f;  // 2^64
+        for (int b = 0; b < 7; ++b) {
+            auto mask = SIMD::greaterThanOrEqual(n, SIMD::expand(bit));
+            n -= SIMD::expand(bit) & mask;
+            scale *= select(mask, SIMD::expand(power), SIMD::expand(1.0f));
+            bit *= 0.5f;
+            power = std::sqrt(power);
+        }
+        return exp2Polynomial(f) * scale;
+    }
+
+    inline SIMD expApprox(SIMD x)
+    {
+        return exp2Approx(x * LOG2_E);
+    }
+
+    // These are what the synth calls. With `precise` they use the standard
+    // library, which is what Synth::preciseMath is for. Setting JX11_FAST_MATH
+    // to 0 always uses the standard library.
+    inline float exp2(float x, bool precise)
+    {
+       #if JX11_FAST_MATH
+        return precise ? std::exp2(x) : exp2Approx(x);
+       #else
+        juce::ignoreUnused(precise);
+        return std::exp2(x);
+       #endif
+    }
+
+    inline float exp(float x, bool precise)
+    {
+       #if JX11_FAST_MATH
+        return precise ? std::exp(x) : expApprox(x);
+       #else
+        juce::ignoreUnused(precise);
+        return std::exp(x);
+       #endif
+    }
+
+    // exp for every lane. With `precise`, the standard library does one lane
+    // at a time.
+    inline SIMD exp(SIMD x, bool precise)
+    {
+       #if JX11_FAST_MATH
+        if (!precise) {
+            return expApprox(x);
+        }
+       #else
+        juce::ignoreUnused(precise);
+       #endif
+        for (size_t i = 0; i < SIMD::size(); ++i) {
+            x.set(i, std::exp(x.get(i)));
+        }
+        return x;
+    }
+
+    inline float sin(float x, bool precise)
+    {
+       #if JX11_FAST_MATH
+        return precise ? std::sin(x) : sinApprox(x);
+       #else
+        juce::ignoreUnused(precise);
+        return std::sin(x);
+       #endif
+    }
+
+    inline float cos(float x, bool precise)
+    {
+       #if JX11_FAST_MATH
+        return precise ? std::cos(x) : cosApprox(x);
+       #else
+        juce::ignoreUnused(precise);
+        return std::cos(x);
+       #endif
+    }
+
+    inline float tan(float x, bool precise)
+    {
+       #if JX11_FAST_MATH
+        return precise ? std::tan(x) : tanApprox(x);
+       #else
+        juce::ignoreUnused(precise);
+        return std::tan(x);
+       #endif
+    }
+}
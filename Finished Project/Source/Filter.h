@@ -1,20 +1,109 @@
 #pragma once
 
+#include "FastMath.h"
+
 #if 1
 
+// Lookup table for the filter's g = tan(PI * cutoff / sampleRate), so that
+// updating the coefficients doesn't need to call tan(). The table is linear
+// in Hz. With linear interpolation between the entries, the cutoff is off by
+// less than 0.01 cents; JX11Bench --accuracy checks this.
+class CutoffTable
+{
+public:
+    // Highest cutoff frequency in the table. Voice never goes above this.
+    static constexpr float MAX_CUTOFF = 20000.0f;
+
+    static constexpr int SIZE = 1024;
+
+    // Fills in the table. Only call this when the sample rate changes,
+    // not from the audio thread.
+    void prepare(float sampleRate)
+    {
+        // Stay below the Nyquist frequency, where tan() goes to infinity.
+        float maxCutoff = std::min(MAX_CUTOFF, sampleRate * 0.49f);
+        scale = float(SIZE) / maxCutoff;
+
+        const double PI = 3.1415926535897932;
+        for (int i = 0; i <= SIZE; ++i) {
+            double cutoff = double(i) * double(maxCutoff) / double(SIZE);
+            table[i] = float(std::tan(PI * cutoff / double(sampleRate)));
+        }
+    }
+
+    float lookup(float cutoff) const
+    {
+        float position = std::clamp(cutoff * scale, 0.0f, float(SIZE));
+        int index = std::min(int(position), SIZE - 1);
+        float fraction = position - float(index);
+        return table[index] + fraction * (table[index + 1] - table[index]);
+    }
+
+private:
+    float scale;
+    float table[SIZE + 1];
+};
+
 // Resonant low-pass filter based on Cytomic SVF.
 class Filter
 {
 public:
     float sampleRate;
 
+    // Set by Synth. The table is shared by all voices; without a table, or
+    // with `preciseMath`, the filter calls tan. rampCoefficients moves the
+    // coefficients to their new values over `rampLength` samples.
+    const CutoffTable* cutoffTable = nullptr;
+    int rampLength = 1;
+    bool preciseMath = false;
+
+    // Changes the coefficients right away.
     void updateCoefficients(float cutoff, float Q)
     {
-        g = std::tan(PI * cutoff / sampleRate);
+        g = FastMath::tan(PI * cutoff / sampleRate, preciseMath);
         k = 1.0f / Q;
         a1 = 1.0f / (1.0f + g * (g + k));
         a2 = g * a1;
         a3 = g * a2;
+
+        a1Step = 0.0f;
+        a2Step = 0.0f;
+        a3Step = 0.0f;
+        firstUpdate = false;
+    }
+
+    // Linearly interpolates the coefficients from their current values to
+    // the new ones, one step per rendered sample. This gives smooth filter
+    // sweeps even though the cutoff is only updated once per control period.
+    // Call this again after at most `rampLength` samples, or the coefficients
+    // will overshoot.
+    void rampCoefficients(float cutoff, float Q)
+    {
+        g = (cutoffTable != nullptr && !preciseMath) ? cutoffTable->lookup(cutoff)
+                                                     : FastMath::tan(PI * cutoff / sampleRate, preciseMath);
+        k = 1.0f / Q;
+        float target1 = 1.0f / (1.0f + g * (g + k));
+        float target2 = g * target1;
+        float target3 = g * target2;
+
+        // Right after a reset there is nothing to ramp from.
+        if (firstUpdate) {
+            a1 = target1;
+            a2 = target2;
+            a3 = target3;
+            a1Step = 0.0f;
+            a2Step = 0.0f;
+            a3Step = 0.0f;
+            firstUpdate = false;
+            return;
+        }
+
+        // Because the steps are computed from the current values, any
+        // rounding errors don't add up over time.
+        float inverseLength = 1.0f / float(rampLength);
+        a1Step = (target1 - a1) * inverseLength;
+        a2Step = (target2 - a2) * inverseLength;
+        a3Step = (target3 - a3) * inverseLength;
     }
 
     void reset()
@@ -24,6 +113,10 @@ public:
         a1 = 0.0f;
         a2 = 0.0f;
         a3 = 0.0f;
+        a1Step = 0.0f;
+        a2Step = 0.0f;
+        a3Step = 0.0f;
+        firstUpdate = true;
 
         ic1eq = 0.0f;
         ic2eq = 0.0f;
@@ -31,6 +124,10 @@ public:
 
     float render(float x)
     {
+        a1 += a1Step;
+        a2 += a2Step;
+        a3 += a3Step;
+
         float v3 = x - ic2eq;
         float v1 = a1 * ic1eq + a2 * v3;
         float v2 = ic2eq + a2 * ic1eq + a3 * v3;
@@ -40,10 +137,14 @@ public:
     }
 
 private:
+    friend class VoiceBank;
+
     const float PI = 3.1415926535897932f;
 
-    float g, k, a1, a2, a3;  // filter coefficients
-    float ic1eq, ic2eq;      // internal state
+    float g, k, a1, a2, a3;        // filter coefficients
+    float a1Step, a2Step, a3Step;  // ramp increments per sample
+    bool firstUpdate;              // don't ramp from the reset values
+    float ic1eq, ic2eq;            // internal state
 };
 
 #else
@@ -61,6 +162,12 @@ public:
         //setDrive(2.0f);
     }
 
+    // The ladder filter already smooths its own parameters.
+    void rampCoefficients(float cutoff, float Q)
+    {
+        updateCoefficients(cutoff, Q);
+    }
+
     float render(float x)
     {
         updateSmoothers();
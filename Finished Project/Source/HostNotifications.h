@@ -0,0 +1,174 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include "EventQueue.h"
+#include "ParameterMapping.h"
+
+// Something that the audio thread changed and that the host must be told
+// about. Telling the host means calling setValueNotifyingHost, which calls
+// into the host and the parameter listeners. Those may lock or allocate, so
+// that has to happen on the message thread.
+struct HostNotification
+{
+    enum class Type : uint8_t
+    {
+        programChange,    // value: the program
+        parameterChange,  // parameter: the ParamIndex, value: normalized
+    };
+
+    Type type;
+    uint8_t parameter;
+    float value;
+
+    // A newer notification replaces an older one with the same slot: one
+    // for program changes and one for each parameter.
+    static constexpr int NUM_SLOTS = 1 + NUM_PARAMS;
+    int slot() const { return type == Type::programChange ? 0 : 1 + int(parameter); }
+};
+
+// Sends notifications from the audio thread to the message thread. Like
+// TelemetryQueue, this is a ring buffer for a single producer and a single
+// consumer, and neither side ever waits for the other. When the ring is full,
+// new notifications are thrown away and counted.
+//
+// Only the newest notification for each slot matters, so the message thread
+// skips the older ones. A volume fader that sends hundreds of messages ends
+// up as one parameter change each time the message thread looks.
+class HostNotificationQueue
+{
+public:
+    // Must be a power of two.
+    static constexpr uint32_t CAPACITY = 1024;
+
+    // Only call this from the audio thread.
+    bool push(const HostNotification& notification)
+    {
+        const uint32_t write = writeIndex.load(std::memory_order_relaxed);
+        const uint32_t read = readIndex.load(std::memory_order_acquire);
+        if (write - read == CAPACITY) {
+            dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        notifications[write & (CAPACITY - 1)] = notification;
+        writeIndex.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Empties the queue and calls `notify(notification)` for the newest
+    // notification for each slot. These calls are in the order in which the
+    // notifications were pushed, so that a program change that came after a
+    // volume change also replaces the output level. Returns the number of
+    // calls. Only call this from the message thread.
+    template<typename NotifyFunction>
+    int drain(NotifyFunction&& notify)
+    {
+        std::array<HostNotification, HostNotification::NUM_SLOTS> newest;
+        std::array<uint32_t, HostNotification::NUM_SLOTS> order {};  // 0 = none
+        uint32_t sequence = 0;
+
+        const uint32_t write = writeIndex.load(std::memory_order_acquire);
+        uint32_t read = readIndex.load(std::memory_order_relaxed);
+        while (read != write) {
+            const HostNotification& notification = notifications[read & (CAPACITY - 1)];
+            size_t slot = size_t(notification.slot());
+            newest[slot] = notification;
+            order[slot] = ++sequence;
+            read += 1;
+        }
+        readIndex.store(read, std::memory_order_release);
+
+        int count = 0;
+        while (true) {
+            int next = -1;
+            for (int slot = 0; slot < HostNotification::NUM_SLOTS; ++slot) {
+                if (order[size_t(slot)] != 0 && (next < 0 || order[size_t(slot)] < order[size_t(next)])) {
+                    next = slot;
+                }
+            }
+            if (next < 0) { break; }
+
+            notify(newest[size_t(next)]);
+            order[size_t(next)] = 0;
+            count += 1;
+        }
+        return count;
+    }
+
+    // How many notifications didn't fit.
+    uint32_t getNumDropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    // The indices only ever go up, see TelemetryQueue.
+    std::atomic<uint32_t> writeIndex { 0 };
+    std::atomic<uint32_t> readIndex { 0 };
+    std::atomic<uint32_t> dropped { 0 };
+    std::array<HostNotification, CAPACITY> notifications;
+};
+
+// The program and parameter changes that the MIDI messages for the plug-in
+// ask for in one block. The whole block uses the same settings, so only the
+// last program change counts, and for each parameter only its last change
+// after that. A volume fader that sends dozens of messages per block makes
+// one change and one host notification. Only use this on the audio thread.
+class HostChanges
+{
+public:
+    void clear()
+    {
+        program = -1;
+        changed = 0;
+    }
+
+    // Handles the messages that always control the plug-in: CC 7 sets the
+    // Output Level and Program Change picks one of the `numPrograms`
+    // programs. Returns false for the other messages.
+    bool add(const SynthEvent& event, int numPrograms)
+    {
+        if (event.type == SynthEvent::Type::controlChange && event.number == 0x07) {
+            changeParameter(ParamIndex::outputLevel, float(event.value) / 127.0f);
+            return true;
+        }
+        if (event.type == SynthEvent::Type::programChange) {
+            if (event.number < numPrograms) {
+                program = event.number;
+                changed = 0;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // For a parameter that is changed by MIDI learn. `value` is normalized.
+    void changeParameter(int parameter, float value)
+    {
+        normalized[parameter] = value;
+        changed |= paramBit(parameter);
+    }
+
+    // Queues one notification for the program and one for each parameter
+    // that changed after it.
+    void notify(HostNotificationQueue& queue) const
+    {
+        if (program >= 0) {
+            queue.push({ HostNotification::Type::programChange, 0, float(program) });
+        }
+        for (int i = 0; i < NUM_PARAMS; ++i) {
+            if (changed & paramBit(i)) {
+                queue.push({ HostNotification::Type::parameterChange, uint8_t(i), normalized[i] });
+            }
+        }
+    }
+
+    // The new program, or -1 if there isn't one.
+    int program = -1;
+
+    // The parameters that changed, one bit per ParamIndex, and their new
+    // values from 0 to 1.
+    uint32_t changed = 0;
+    float normalized[NUM_PARAMS];
+};
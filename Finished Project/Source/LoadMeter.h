@@ -0,0 +1,221 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+// Counts how often the load falls into each 1% wide bin, from 0% up to 200%.
+// The load is the time it took to process a block divided by the duration of
+// that block. The last bin is for everything above 200%.
+//
+// Only the audio thread adds to the histogram. Any other thread may read it at
+// the same time. It might then see a block in one bin but not yet in another,
+// which doesn't matter for statistics over thousands of blocks.
+class LoadHistogram
+{
+public:
+    static constexpr int NUM_BINS = 201;
+
+    void add(double load)
+    {
+        int bin = std::min(int(load * 100.0), NUM_BINS - 1);
+        increment(bins[size_t(bin)]);
+        increment(count);
+        if (float(load) > maxLoad.load(std::memory_order_relaxed)) {
+            maxLoad.store(float(load), std::memory_order_relaxed);
+        }
+    }
+
+    void clear()
+    {
+        for (auto& bin : bins) { bin.store(0, std::memory_order_relaxed); }
+        count.store(0, std::memory_order_relaxed);
+        maxLoad.store(0.0f, std::memory_order_relaxed);
+    }
+
+    uint32_t getCount() const { return count.load(std::memory_order_relaxed); }
+    uint32_t getBin(int bin) const { return bins[size_t(bin)].load(std::memory_order_relaxed); }
+    double getMax() const { return double(maxLoad.load(std::memory_order_relaxed)); }
+
+    // The load that `fraction` of the blocks stayed below, for example 0.99
+    // for the 99th percentile. This is the upper edge of the bin, so it's
+    // never less than the real percentile, and at most 1% more.
+    double percentile(double fraction) const
+    {
+        uint64_t total = getCount();
+        if (total == 0) { return 0.0; }
+
+        uint64_t wanted = uint64_t(std::ceil(fraction * double(total)));
+        uint64_t seen = 0;
+        for (int bin = 0; bin < NUM_BINS - 1; ++bin) {
+            seen += getBin(bin);
+            if (seen >= wanted) {
+                return std::min(double(bin + 1) / 100.0, getMax());
+            }
+        }
+        return getMax();
+    }
+
+private:
+    static void increment(std::atomic<uint32_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint32_t>, NUM_BINS> bins {};
+    std::atomic<uint32_t> count { 0 };
+    std::atomic<float> maxLoad { 0.0f };
+};
+
+// Measures how close processBlock comes to its deadline. For every block,
+// processBlock reports how long the whole block, the parameter update, and
+// Synth::render took. This keeps a load histogram for each of these, and for
+// the whole block also one per number of voices, plus how many blocks took
+// longer than their duration, in total and per preset.
+//
+// The host needs some time of its own, so the real deadline is a bit earlier.
+// A load of 100% always means a dropout, but so may a load of 80%.
+class LoadMeter
+{
+public:
+    enum Stage { block, update, render, NUM_STAGES };
+
+    // The histograms per number of voices are for 0 voices, 1 - 4, 5 - 8,
+    // 9 - 16, 17 - 32, 33 - 64, and 65 - 128.
+    static constexpr int NUM_VOICE_RANGES = 7;
+
+    // Presets with a higher index are counted with the last one.
+    static constexpr int MAX_PRESETS = 128;
+
+    // Adds the measurements for one block. The times are in high resolution
+    // ticks. Only call this from the audio thread.
+    void addBlock(int64_t blockTicks, int64_t updateTicks, int64_t renderTicks,
+                  int sampleCount, double sampleRate, int preset, int voices)
+    {
+        if (clearRequested.exchange(false, std::memory_order_acquire)) {
+            clearAll();
+        }
+        if (sampleCount <= 0 || sampleRate <= 0.0) { return; }
+
+        // Ticks per second divided by samples per second.
+        double ticksPerSample = double(juce::Time::getHighResolutionTicksPerSecond()) / sampleRate;
+        double budget = ticksPerSample * double(sampleCount);
+
+        double load = double(blockTicks) / budget;
+        stages[block].add(load);
+        stages[update].add(double(updateTicks) / budget);
+        stages[render].add(double(renderTicks) / budget);
+        byVoices[size_t(voiceRange(voices))].add(load);
+
+        preset = juce::jlimit(0, MAX_PRESETS - 1, preset);
+        increment(presetBlocks[size_t(preset)]);
+        if (load > 1.0) {
+            increment(overruns);
+            increment(presetOverruns[size_t(preset)]);
+        }
+    }
+
+    // Asks the audio thread to start over at the next block. This may be
+    // called from any thread.
+    void clear()
+    {
+        clearRequested.store(true, std::memory_order_release);
+    }
+
+    const LoadHistogram& getHistogram(Stage stage) const { return stages[size_t(stage)]; }
+    const LoadHistogram& getHistogramForVoices(int range) const { return byVoices[size_t(range)]; }
+    uint32_t getNumOverruns() const { return overruns.load(std::memory_order_relaxed); }
+
+    // One line of text for the editor.
+    juce::String getSummary() const
+    {
+        const LoadHistogram& histogram = stages[block];
+        auto percent = [](double load) { return juce::String(juce::roundToInt(load * 100.0)) + "%"; };
+        return "CPU load p50 " + percent(histogram.percentile(0.5))
+             + "  p99 " + percent(histogram.percentile(0.99))
+             + "  p99.9 " + percent(histogram.percentile(0.999))
+             + "  max " + percent(histogram.getMax())
+             + "  overruns " + juce::String(int(getNumOverruns()))
+             + " of " + juce::String(int(histogram.getCount()));
+    }
+
+    // Writes the percentiles, also per number of voices, the overruns per
+    // preset, and the full histograms as CSV. Presets without a name in
+    // `presetNames` show up as their index.
+    void writeReport(juce::OutputStream& out, const juce::StringArray& presetNames) const
+    {
+        static const char* stageNames[NUM_STAGES] = { "processBlock", "update", "render" };
+        static const char* voiceNames[NUM_VOICE_RANGES] = {
+            "0", "1-4", "5-8", "9-16", "17-32", "33-64", "65-128"
+        };
+
+        out << "measurement,blocks,p50,p99,p99.9,max\n";
+        for (int stage = 0; stage < NUM_STAGES; ++stage) {
+            writePercentiles(out, stageNames[stage], stages[size_t(stage)]);
+        }
+        for (int range = 0; range < NUM_VOICE_RANGES; ++range) {
+            writePercentiles(out, juce::String("voices ") + voiceNames[range], byVoices[size_t(range)]);
+        }
+
+        out << "\npreset,blocks,overruns\n";
+        for (int preset = 0; preset < MAX_PRESETS; ++preset) {
+            uint32_t blocks = presetBlocks[size_t(preset)].load(std::memory_order_relaxed);
+            if (blocks > 0) {
+                juce::String name = preset < presetNames.size() ? presetNames[preset] : juce::String(preset);
+                out << "\"" << name << "\"," << int(blocks) << ","
+                    << int(presetOverruns[size_t(preset)].load(std::memory_order_relaxed)) << "\n";
+            }
+        }
+
+        out << "\nload %,processBlock,update,render\n";
+        for (int bin = 0; bin < LoadHistogram::NUM_BINS; ++bin) {
+            out << bin;
+            for (int stage = 0; stage < NUM_STAGES; ++stage) {
+                out << "," << int(stages[size_t(stage)].getBin(bin));
+            }
+            out << "\n";
+        }
+    }
+
+private:
+    static int voiceRange(int voices)
+    {
+        static const int highest[NUM_VOICE_RANGES - 1] = { 0, 4, 8, 16, 32, 64 };
+        int range = 0;
+        while (range < NUM_VOICE_RANGES - 1 && voices > highest[range]) {
+            range += 1;
+        }
+        return range;
+    }
+
+    static void writePercentiles(juce::OutputStream& out, const juce::String& name,
+                                 const LoadHistogram& histogram)
+    {
+        out << name << "," << int(histogram.getCount()) << ","
+            << juce::String(histogram.percentile(0.5), 2) << ","
+            << juce::String(histogram.percentile(0.99), 2) << ","
+            << juce::String(histogram.percentile(0.999), 2) << ","
+            << juce::String(histogram.getMax(), 2) << "\n";
+    }
+
+    static void increment(std::atomic<uint32_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void clearAll()
+    {
+        for (auto& histogram : stages) { histogram.clear(); }
+        for (auto& histogram : byVoices) { histogram.clear(); }
+        for (auto& counter : presetBlocks) { counter.store(0, std::memory_order_relaxed); }
+        for (auto& counter : presetOverruns) { counter.store(0, std::memory_order_relaxed); }
+        overruns.store(0, std::memory_order_relaxed);
+    }
+
+    std::array<LoadHistogram, NUM_STAGES> stages;
+    std::array<LoadHistogram, NUM_VOICE_RANGES> byVoices;
+    std::array<std::atomic<uint32_t>, MAX_PRESETS> presetBlocks {};
+    std::array<std::atomic<uint32_t>, MAX_PRESETS> presetOverruns {};
+    std::atomic<uint32_t> overruns { 0 };
+    std::atomic<bool> clearRequested { false };
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include "EventQueue.h"
+#include "ParameterMapping.h"
+
+// Which preset parameter each MIDI controller changes.
+//
+// There is one entry per control change number, so the audio thread finds
+// the parameter for a controller with a single atomic load, no matter how
+// many controllers are mapped. Only the message thread changes the entries,
+// and it stores each one atomically, so the audio thread never waits. While
+// a mapping changes, the audio thread may briefly see one half of a 14-bit
+// pair without the other, which only means that a message is ignored.
+//
+// Controllers 0 - 31 can be paired with 32 - 63 for 14-bit values: the first
+// sends the upper 7 bits and the second the lower 7 bits.
+class MidiLearnTable
+{
+public:
+    static constexpr int NUM_CONTROLLERS = 128;
+    static constexpr int NUM_PAIRS = 32;
+
+    // The volume controller and the sustain pedal already have a job, and
+    // from 0x78 up are the channel mode messages.
+    static bool canLearn(int controller)
+    {
+        return controller >= 0 && controller < 0x78 && controller != 0x07 && controller != 0x40;
+    }
+
+    // Maps the controller to the parameter. With `highResolution`, this also
+    // maps the other controller of the pair, if there is one. The parameter
+    // loses its old controllers, and the controllers their old parameters.
+    // Only call this from the message thread.
+    void map(int controller, int parameter, bool highResolution)
+    {
+        if (!canLearn(controller) || parameter < 0 || parameter >= NUM_PARAMS) { return; }
+
+        if (highResolution && controller >= NUM_PAIRS && controller < 2 * NUM_PAIRS) {
+            controller -= NUM_PAIRS;
+        }
+        highResolution = highResolution && controller < NUM_PAIRS;
+
+        forgetParameter(parameter);
+        forgetController(controller);
+        if (highResolution) {
+            forgetController(controller + NUM_PAIRS);
+            store(controller + NUM_PAIRS, lower, parameter);
+            store(controller, upper, parameter);
+        } else {
+            store(controller, coarse, parameter);
+        }
+    }
+
+    // Removes the mappings to the parameter. Only call this from the message
+    // thread.
+    void forgetParameter(int parameter)
+    {
+        for (int controller = 0; controller < NUM_CONTROLLERS; ++controller) {
+            if (getParameter(controller) == parameter) {
+                store(controller, none, 0);
+            }
+        }
+    }
+
+    // Only call this from the message thread.
+    void clear()
+    {
+        for (auto& entry : entries) { entry.store(0, std::memory_order_relaxed); }
+    }
+
+    // The parameter that the controller changes, or -1.
+    int getParameter(int controller) const
+    {
+        uint16_t entry = entries[size_t(controller)].load(std::memory_order_relaxed);
+        return (entry >> 8) == none ? -1 : int(entry & 0xFF);
+    }
+
+    // Whether the controller sends the upper half of a 14-bit value.
+    bool isHighResolution(int controller) const
+    {
+        return (entries[size_t(controller)].load(std::memory_order_relaxed) >> 8) == upper;
+    }
+
+    // Whether the controller sends the lower half of a 14-bit value.
+    bool isLowerHalf(int controller) const
+    {
+        return (entries[size_t(controller)].load(std::memory_order_relaxed) >> 8) == lower;
+    }
+
+    // Whether the event is a control change that has a mapping.
+    bool isMapped(const SynthEvent& event) const
+    {
+        return event.type == SynthEvent::Type::controlChange
+            && entries[event.number].load(std::memory_order_relaxed) != 0;
+    }
+
+    // If the event is a control change that has a mapping, puts the parameter
+    // and its new value, from 0 to 1, into `parameter` and `value`, and returns
+    // true. Only call this from the audio thread.
+    bool handle(const SynthEvent& event, int& parameter, float& value)
+    {
+        if (event.type != SynthEvent::Type::controlChange) { return false; }
+
+        uint16_t entry = entries[event.number].load(std::memory_order_relaxed);
+        parameter = int(entry & 0xFF);
+        switch (entry >> 8) {
+            case coarse:
+                value = float(event.value) / 127.0f;
+                return true;
+
+            // Like most synths, a new upper half starts with a lower half of
+            // zero, so that a controller that only sends the upper half still
+            // reaches every value.
+            case upper: {
+                int pair = event.number;
+                upperBits[size_t(pair)] = uint8_t(event.value);
+                lowerBits[size_t(pair)] = 0;
+                value = highResolutionValue(pair);
+                return true;
+            }
+
+            case lower: {
+                int pair = event.number - NUM_PAIRS;
+                lowerBits[size_t(pair)] = uint8_t(event.value);
+                value = highResolutionValue(pair);
+                return true;
+            }
+
+            default:
+                return false;
+        }
+    }
+
+    // The mappings, for saving with the plug-in's state. The parameters are
+    // stored by their ID, so that the order of the parameters may change.
+    std::unique_ptr<juce::XmlElement> createXml() const
+    {
+        auto xml = std::make_unique<juce::XmlElement>(XML_TAG);
+        for (int controller = 0; controller < NUM_CONTROLLERS; ++controller) {
+            // The lower half of a pair is saved with the upper half.
+            int parameter = getParameter(controller);
+            if (parameter >= 0 && !isLowerHalf(controller)) {
+                auto* mapping = xml->createNewChildElement("Mapping");
+                mapping->setAttribute("controller", controller);
+                mapping->setAttribute("parameter", getParameterID(parameter).getParamID());
+                mapping->setAttribute("highResolution", isHighResolution(controller) ? 1 : 0);
+            }
+        }
+        return xml;
+    }
+
+    // Replaces the mappings with the ones from createXml. Mappings to unknown
+    // parameters are skipped. Only call this from the message thread.
+    void loadXml(const juce::XmlElement& xml)
+    {
+        clear();
+        for (auto* mapping : xml.getChildWithTagNameIterator("Mapping")) {
+            juce::String id = mapping->getStringAttribute("parameter");
+            for (int parameter = 0; parameter < NUM_PARAMS; ++parameter) {
+                if (getParameterID(parameter).getParamID() == id) {
+                    map(mapping->getIntAttribute("controller", -1), parameter,
+                        mapping->getIntAttribute("highResolution", 0) != 0);
+                }
+            }
+        }
+    }
+
+    static constexpr const char* XML_TAG = "MidiLearn";
+
+private:
+    // Each entry holds the kind of mapping in the upper byte and the
+    // ParamIndex in the lower byte.
+    enum Kind : uint16_t { none, coarse, upper, lower };
+
+    void store(int controller, Kind kind, int parameter)
+    {
+        entries[size_t(controller)].store(uint16_t((kind << 8) | parameter), std::memory_order_relaxed);
+    }
+
+    // Removes the mapping of the controller, and of the other controller of
+    // its pair if it is part of one.
+    void forgetController(int controller)
+    {
+        uint16_t kind = entries[size_t(controller)].load(std::memory_order_relaxed) >> 8;
+        if (kind == upper) {
+            store(controller + NUM_PAIRS, none, 0);
+        } else if (kind == lower) {
+            store(controller - NUM_PAIRS, none, 0);
+        }
+        store(controller, none, 0);
+    }
+
+    float highResolutionValue(int pair) const
+    {
+        int bits = upperBits[size_t(pair)] * 128 + lowerBits[size_t(pair)];
+        return float(bits) / 16383.0f;
+    }
+
+    std::array<std::atomic<uint16_t>, NUM_CONTROLLERS> entries {};
+
+    // The last two halves of each 14-bit pair. Only used on the audio thread.
+    std::array<uint8_t, NUM_PAIRS> upperBits {};
+    std::array<uint8_t, NUM_PAIRS> lowerBits {};
+};
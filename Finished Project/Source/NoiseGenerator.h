@@ -21,6 +21,27 @@ public:
         return float(temp) / 16777216.0f;
     }
 
+    // Moves ahead by `count` values without computing them. Doing `count`
+    // steps of the generator at once is the same as a single step with a
+    // different multiplier and increment. These are found by repeated
+    // squaring, so this takes only a few steps even for large counts.
+    void skip(int count)
+    {
+        unsigned int multiplier = 196314165;
+        unsigned int increment = 907633515;
+        unsigned int totalMultiplier = 1;
+        unsigned int totalIncrement = 0;
+        for (unsigned int n = unsigned(count); n > 0; n >>= 1) {
+            if (n & 1) {
+                totalMultiplier *= multiplier;
+                totalIncrement = totalIncrement * multiplier + increment;
+            }
+            increment *= multiplier + 1;
+            multiplier *= multiplier;
+        }
+        noiseSeed = noiseSeed * totalMultiplier + totalIncrement;
+    }
+
 private:
     unsigned int noiseSeed;
 };
@@ -1,12 +1,14 @@
 #pragma once
 
 #include <cmath>
+#include "FastMath.h"
 
 const float PI_OVER_4 = 0.7853981633974483f;
 const float PI = 3.1415926535897932f;
 const float TWO_PI = 6.2831853071795864f;
 
-// Bandlimited impulse train (BLIT) oscillator.
+// Bandlimited impulse train (BLIT) oscillator. This can also output a PolyBLEP
+// sawtooth wave, which is cheaper to compute but has a little more aliasing.
 class Oscillator
 {
 public:
@@ -19,6 +21,9 @@ public:
     // Output level for this oscillator.
     float amplitude = 1.0f;
 
+    // Use the standard library for the sine instead of FastMath.
+    bool preciseMath = false;
+
     void reset()
     {
         inc = 0.0f;
@@ -27,6 +32,8 @@ public:
         sin1 = 0.0f;
         dsin = 0.0f;
         dc = 0.0f;
+        blepPhase = 0.0f;
+        blepInc = 0.0f;
     }
 
     // Creates a sinc pulse every `period` samples.
@@ -69,9 +76,9 @@ public:
             phase = -phase;
 
             // Initialize the sine oscillator.
-            sin0 = amplitude * std::sin(phase);
-            sin1 = amplitude * std::sin(phase - inc);
-            dsin = 2.0f * std::cos(inc);
+            sin0 = amplitude * FastMath::sin(phase, preciseMath);
+            sin1 = amplitude * FastMath::sin(phase - inc, preciseMath);
+            dsin = 2.0f * FastMath::cos(inc, preciseMath);
 
             // Output the peak of the sinc pulse. Make sure to not divide by 0.
             if (phase*phase > 1e-9) {
@@ -100,6 +107,53 @@ public:
         return output - dc;
     }
 
+    // Creates a sawtooth wave using PolyBLEP. Unlike the impulse train from
+    // nextSample, this is already a sawtooth and does not need integrating.
+    // It has the same shape: a jump up at the start of every cycle, followed
+    // by a ramp down.
+    float nextSawtooth()
+    {
+        // Very first sample? Then set the period.
+        if (blepInc == 0.0f) {
+            blepInc = 1.0f / (period * modulation);
+        }
+
+        // The naive sawtooth goes from +0.5 down to -0.5.
+        float output = 0.5f - blepPhase;
+
+        // The jump in the naive sawtooth causes aliasing. PolyBLEP rounds off
+        // the jump using a polynomial over the sample right before the jump
+        // and the sample right after it.
+        if (blepPhase < blepInc) {
+            float x = blepPhase / blepInc;
+            output += 0.5f * (x + x - x*x - 1.0f);
+        } else if (blepPhase > 1.0f - blepInc) {
+            float x = (blepPhase - 1.0f) / blepInc;
+            output += 0.5f * (x*x + x + x + 1.0f);
+        }
+
+        // Just like the BLIT, the period only changes at the start of a cycle.
+        // This also means there is only one division per cycle.
+        blepPhase += blepInc;
+        if (blepPhase >= 1.0f) {
+            blepPhase -= 1.0f;
+            blepInc = 1.0f / (period * modulation);
+        }
+
+        return amplitude * output;
+    }
+
+    // Converts the period when the sample rate changes. `ratio` is the new
+    // rate divided by the old one. The PolyBLEP phase is a fraction of the
+    // cycle, so that simply continues at the new rate. The BLIT cycle that
+    // is already playing finishes at its old length in samples, so that one
+    // cycle will be a little off in pitch.
+    void changeSampleRate(float ratio)
+    {
+        period *= ratio;
+        blepInc /= ratio;
+    }
+
     void squareWave(Oscillator& other, float newPeriod)
     {
         reset();
@@ -127,6 +181,11 @@ public:
         // Shift by 180 degrees relative to the other sawtooth wave.
         phase += PI * newPeriod / 2.0f;
         phaseMax = phase;
+
+        // Do the same for the PolyBLEP sawtooth.
+        blepInc = (other.blepInc > 0.0f) ? other.blepInc : 1.0f / newPeriod;
+        blepPhase = other.blepPhase + 0.5f;
+        if (blepPhase >= 1.0f) { blepPhase -= 1.0f; }
     }
 
 private:
@@ -146,4 +205,8 @@ private:
 
     // DC offset. This is subtracted to create the sawtooth wave.
     float dc;
+
+    // Phase of the PolyBLEP sawtooth, between 0 and 1, and its increment.
+    float blepPhase;
+    float blepInc;
 };
@@ -0,0 +1,426 @@
+#include "ParameterMapping.h"
+#include "Synth.h"
+
+const juce::ParameterID& getParameterID(int index)
+{
+    static const juce::ParameterID* ids[NUM_PARAMS] = {
+        &ParameterID::oscMix,
+        &ParameterID::oscTune,
+        &ParameterID::oscFine,
+        &ParameterID::glideMode,
+        &ParameterID::glideRate,
+        &ParameterID::glideBend,
+        &ParameterID::filterFreq,
+        &ParameterID::filterReso,
+        &ParameterID::filterEnv,
+        &ParameterID::filterLFO,
+        &ParameterID::filterVelocity,
+        &ParameterID::filterAttack,
+        &ParameterID::filterDecay,
+        &ParameterID::filterSustain,
+        &ParameterID::filterRelease,
+        &ParameterID::envAttack,
+        &ParameterID::envDecay,
+        &ParameterID::envSustain,
+        &ParameterID::envRelease,
+        &ParameterID::lfoRate,
+        &ParameterID::vibrato,
+        &ParameterID::noise,
+        &ParameterID::octave,
+        &ParameterID::tuning,
+        &ParameterID::outputLevel,
+        &ParameterID::polyMode,
+        &ParameterID::oscEngine,
+        &ParameterID::controlRate,
+        &ParameterID::oversampling,
+    };
+    return *ids[index];
+}
+
+int controlPeriodForChoice(int choice, float sampleRate, int oversampling)
+{
+    // The first four are a fixed number of samples, so the CPU cost per
+    // second goes up with the sample rate. The others are a fixed rate in Hz,
+    // so that the modulation is the same at any sample rate.
+    static const int samples[] = { 8, 16, 32, 64 };
+    static const float rates[] = { 1000.0f, 2000.0f, 4000.0f };
+
+    int period = 32 * oversampling;
+    if (choice >= 0 && choice < 4) {
+        period = samples[choice] * oversampling;
+    } else if (choice >= 4 && choice < 7) {
+        period = int(std::round(sampleRate * float(oversampling) / rates[choice - 4]));
+    }
+    return std::clamp(period, Synth::MIN_CONTROL_PERIOD, Synth::MAX_CONTROL_PERIOD);
+}
+
+const QualityProfile& qualityProfileForChoice(int choice, bool offline)
+{
+    if (choice == 2 || (choice == 0 && offline)) {
+        return QualityProfiles::high;
+    }
+    return QualityProfiles::lean;
+}
+
+void applyQualityProfile(Synth& synth, const QualityProfile& profile, float* values)
+{
+    setQualityValues(profile, values);
+    synth.preciseMath = profile.preciseMath;
+}
+
+void setQualityValues(const QualityProfile& profile, float* values)
+{
+    if (profile.controlRate != QualityProfile::KEEP) {
+        values[ParamIndex::controlRate] = float(profile.controlRate);
+    }
+    if (profile.oscEngine != QualityProfile::KEEP) {
+        values[ParamIndex::oscEngine] = float(profile.oscEngine);
+    }
+    if (profile.oversampling != QualityProfile::KEEP) {
+        values[ParamIndex::oversampling] = float(profile.oversampling);
+    }
+}
+
+void applyStealingChoice(Synth& synth, int choice)
+{
+    VoiceAllocator::Policy policy;
+    policy.oldest = (choice == 1);
+    policy.retriggerSameNote = (choice == 2);
+    policy.protectLowestNote = (choice == 3);
+    policy.protectHighestNote = (choice == 4);
+    synth.stealPolicy = policy;
+}
+
+int midiToleranceForChoice(int choice, double sampleRate)
+{
+    static const double milliseconds[] = { 0.0, 1.0, 3.0, 10.0 };
+    if (choice < 0 || choice > 3) { return 0; }
+    return int(sampleRate * milliseconds[choice] / 1000.0);
+}
+
+uint32_t updateSettings(SynthSettings& settings, const float* values, float sampleRate, uint32_t changed)
+{
+    // The plug-in calls this from the audio callback whenever any of the
+    // parameters have changed. The bits in `changed` say which parameters
+    // these are, and only the settings that depend on those parameters get
+    // recalculated. That matters when one knob is heavily automated, because
+    // many of these formulas use exp or pow.
+
+    // The voices run at the oversampled rate, so anything that is measured
+    // in samples depends on the oversampling factor. Recalculate all of that
+    // when the factor changes. The control rate stays the same in Hz.
+    if (changed & paramBit(ParamIndex::oversampling)) {
+        settings.oversampling = 1 << std::clamp(int(values[ParamIndex::oversampling]), 0, 2);
+        changed |= paramBit(ParamIndex::envAttack) | paramBit(ParamIndex::envDecay)
+                 | paramBit(ParamIndex::envRelease) | paramBit(ParamIndex::noise)
+                 | paramBit(ParamIndex::octave) | paramBit(ParamIndex::controlRate);
+    }
+
+    // From here on, `sampleRate` is the rate that the voices run at.
+    const int oversampling = settings.oversampling;
+    const float hostSampleRate = sampleRate;
+    sampleRate *= float(oversampling);
+    float inverseSampleRate = 1.0f / sampleRate;
+
+    // The settings that are updated once per control period depend on its
+    // length, so recalculate them all when it changes.
+    if (changed & paramBit(ParamIndex::controlRate)) {
+        settings.controlPeriod = controlPeriodForChoice(int(values[ParamIndex::controlRate]),
+                                                        hostSampleRate, oversampling);
+        changed |= paramBit(ParamIndex::lfoRate) | paramBit(ParamIndex::glideRate)
+                 | paramBit(ParamIndex::filterAttack) | paramBit(ParamIndex::filterDecay)
+                 | paramBit(ParamIndex::filterRelease);
+    }
+
+    // The envelope is implemented using a simple one-pole filter, which creates
+    // an analog-style exponential curve. The formulas below calculate the filter
+    // coefficients for the attack, decay, and release stages.
+    if (changed & paramBit(ParamIndex::envAttack)) {
+        settings.envAttack = std::exp(-inverseSampleRate * std::exp(5.5f - 0.075f * values[ParamIndex::envAttack]));
+    }
+    if (changed & paramBit(ParamIndex::envDecay)) {
+        settings.envDecay = std::exp(-inverseSampleRate * std::exp(5.5f - 0.075f * values[ParamIndex::envDecay]));
+    }
+    if (changed & paramBit(ParamIndex::envSustain)) {
+        settings.envSustain = values[ParamIndex::envSustain] / 100.0f;
+    }
+    if (changed & paramBit(ParamIndex::envRelease)) {
+        float envRelease = values[ParamIndex::envRelease];
+        if (envRelease < 1.0f) {
+            settings.envRelease = 0.75f;  // extra fast release
+        } else {
+            settings.envRelease = std::exp(-inverseSampleRate * std::exp(5.5f - 0.075f * envRelease));
+        }
+    }
+
+    // How much noise to mix into the signal. This is a parabolic curve,
+    // similar to creating a parameter with skew = 0.5.
+    float noiseMix = values[ParamIndex::noise] / 100.0f;
+    noiseMix *= noiseMix;
+    noiseMix *= 0.06f;
+
+    // With oversampling, the same noise is spread out over a wider frequency
+    // range, so less of it ends up below 20 kHz. Make it louder to make up
+    // for this.
+    if (changed & paramBit(ParamIndex::noise)) {
+        settings.noiseMix = noiseMix * std::sqrt(float(oversampling));
+    }
+
+    // How much to mix osc2 into the output. This is a value between 0 and 1.
+    float oscMix = values[ParamIndex::oscMix] / 100.0f;
+    if (changed & paramBit(ParamIndex::oscMix)) {
+        settings.oscMix = oscMix;
+    }
+
+    // Calculate the multiplication factor for detuning oscillator 2. This is
+    // the same as 2^(N/12) where N is the number of (fractional) semitones.
+    // This value will be multiplied with the oscillator period, which is why
+    // detuning down is greater than 1, as lowering the pitch means the period
+    // becomes longer. Vice versa for going up in pitch.
+    if (changed & (paramBit(ParamIndex::oscTune) | paramBit(ParamIndex::oscFine))) {
+        float semi = values[ParamIndex::oscTune];
+        float cent = values[ParamIndex::oscFine];
+        settings.detune = std::pow(1.059463094359f, -semi - 0.01f * cent);
+    }
+
+    // Master tuning. See the book for a full explanation of what happens here.
+    if (changed & (paramBit(ParamIndex::octave) | paramBit(ParamIndex::tuning))) {
+        float octave = values[ParamIndex::octave];  // -2 to +2
+        float tuning = values[ParamIndex::tuning];  // -100 to +100
+        float tuneInSemi = -36.3763f - 12.0f * octave - tuning / 100.0f;
+        settings.tune = sampleRate * std::exp(0.05776226505f * tuneInSemi);
+    }
+
+    // Mono or poly? In poly mode, the parameter also chooses the number of
+    // voices: 8, 16, 32, 64, or 128.
+    if (changed & paramBit(ParamIndex::polyMode)) {
+        int polyMode = int(values[ParamIndex::polyMode]);
+        settings.numVoices = (polyMode == 0) ? 1 : std::min(4 << polyMode, Synth::MAX_VOICES);
+    }
+
+    // Which oscillators to use. The BLIT sounds a little cleaner, PolyBLEP
+    // is faster with many voices.
+    if (changed & paramBit(ParamIndex::oscEngine)) {
+        settings.polyBLEP = (int(values[ParamIndex::oscEngine]) == 1);
+    }
+
+    // Convert decibels to gain. Use a smoother for this parameter.
+    if (changed & paramBit(ParamIndex::outputLevel)) {
+        settings.outputLevel = juce::Decibels::decibelsToGain(values[ParamIndex::outputLevel]);
+    }
+
+    // Filter velocity sensitivity, a value between -0.05 and +0.05.
+    // If disabled, the velocity is completely ignored.
+    if (changed & paramBit(ParamIndex::filterVelocity)) {
+        float filterVelocity = values[ParamIndex::filterVelocity];
+        if (filterVelocity < -90.0f) {
+            settings.velocitySensitivity = 0.0f;  // turn off velocity
+            settings.ignoreVelocity = true;
+        } else {
+            settings.velocitySensitivity = 0.0005f * filterVelocity;
+            settings.ignoreVelocity = false;
+        }
+    }
+
+    // Use a lower update rate for the glide and filter envelope, once per
+    // control period.
+    const float inverseUpdateRate = inverseSampleRate * float(settings.controlPeriod);
+
+    // The LFO rate is an exponentional curve that maps the 0 - 1 parameter
+    // value to 0.018 Hz - 20.09 Hz. Use this to calculate the phase increment
+    // for a sine wave running at the control rate.
+    if (changed & paramBit(ParamIndex::lfoRate)) {
+        float lfoRate = std::exp(7.0f * values[ParamIndex::lfoRate] - 4.0f);
+        settings.lfoInc = lfoRate * inverseUpdateRate * float(TWO_PI);
+    }
+
+    // The vibrato parameter is a parabolic curve going from 0.0 for 0% up to
+    // 0.05 for 100%. You can choose between PWM mode (to the left) and vibrato
+    // mode (to the right). These values are used as the amplitude of the LFO
+    // sine wave that modulates the oscillator periods.
+    if (changed & paramBit(ParamIndex::vibrato)) {
+        float vibrato = values[ParamIndex::vibrato] / 200.0f;
+        settings.vibrato = 0.2f * vibrato * vibrato;
+        settings.pwmDepth = settings.vibrato;
+        if (vibrato < 0.0f) { settings.vibrato = 0.0f; }
+    }
+
+    // Need to glide?
+    if (changed & paramBit(ParamIndex::glideMode)) {
+        settings.glideMode = int(values[ParamIndex::glideMode]);
+    }
+
+    // Just like the envelope, glide is implemented using a one-pole filter
+    // that is updated once per control period. Here we set the filter
+    // coefficient. A smaller coefficient means the glide takes longer.
+    if (changed & paramBit(ParamIndex::glideRate)) {
+        float glideRate = values[ParamIndex::glideRate];
+        if (glideRate < 2.0f) {
+            settings.glideRate = 1.0f;  // no glide
+        } else {
+            settings.glideRate = 1.0f - std::exp(-inverseUpdateRate * std::exp(6.0f - 0.07f * glideRate));
+        }
+    }
+
+    // Glide bend goes from -36 semitones to +36 semitones.
+    if (changed & paramBit(ParamIndex::glideBend)) {
+        settings.glideBend = values[ParamIndex::glideBend];
+    }
+
+    // The filter's cutoff is set using the note's pitch and velocity. This
+    // parameter shifts that cutoff up or down. Values are from -1.5 to 6.5.
+    if (changed & paramBit(ParamIndex::filterFreq)) {
+        settings.filterKeyTracking = 0.08f * values[ParamIndex::filterFreq] - 1.5f;
+    }
+
+    // Filter Q. Starts at 1 and goes up to 20, approximately.
+    float filterReso = values[ParamIndex::filterReso] / 100.0f;
+    if (changed & paramBit(ParamIndex::filterReso)) {
+        settings.filterQ = std::exp(3.0f * filterReso);
+    }
+
+    // Self-oscillation:
+    //settings.filterQ = (1.0f / ((1.0f - filterReso + 1e-9) * (1.0f - filterReso + 1e-9)));
+
+    // When using both oscillators, and/or noise or large filter resonance,
+    // the overall gain increases. This variable tries to compensate for that.
+    // There is also a manual output level control, as the total volume also
+    // depends on how many notes are playing, their envelopes, velocities, etc.
+    if (changed & (paramBit(ParamIndex::oscMix) | paramBit(ParamIndex::noise) | paramBit(ParamIndex::filterReso))) {
+        settings.volumeTrim = 0.0008f * (3.2f - oscMix - 25.0f * noiseMix) * (1.5f - 0.5f * filterReso);
+    }
+
+    // Filter LFO intensity. Parabolic curve from 0 to 2.5.
+    if (changed & paramBit(ParamIndex::filterLFO)) {
+        float filterLFO = values[ParamIndex::filterLFO] / 100.0f;
+        settings.filterLFODepth = 2.5f * filterLFO * filterLFO;
+    }
+
+    // The filter envelope uses the same formulas as the amplitude envelope
+    // but runs at the control rate, the same update rate as the LFO.
+    if (changed & paramBit(ParamIndex::filterAttack)) {
+        settings.filterAttack = std::exp(-inverseUpdateRate * std::exp(5.5f - 0.075f * values[ParamIndex::filterAttack]));
+    }
+    if (changed & paramBit(ParamIndex::filterDecay)) {
+        settings.filterDecay = std::exp(-inverseUpdateRate * std::exp(5.5f - 0.075f * values[ParamIndex::filterDecay]));
+    }
+    if (changed & paramBit(ParamIndex::filterSustain)) {
+        float filterSustain = values[ParamIndex::filterSustain] / 100.0f;
+        settings.filterSustain = filterSustain * filterSustain;
+    }
+    if (changed & paramBit(ParamIndex::filterRelease)) {
+        settings.filterRelease = std::exp(-inverseUpdateRate * std::exp(5.5f - 0.075f * values[ParamIndex::filterRelease]));
+    }
+
+    // Filter envelope intensity. Linear curve from -6.0 to +6.0.
+    if (changed & paramBit(ParamIndex::filterEnv)) {
+        settings.filterEnvDepth = 0.06f * values[ParamIndex::filterEnv];
+    }
+
+    return changed;
+}
+
+void applySettings(Synth& synth, const SynthSettings& settings, uint32_t changed)
+{
+    // Only the settings for the parameters in `changed` are copied. The
+    // smoothed settings ramp to their new values instead of jumping to them.
+    if (changed & paramBit(ParamIndex::oversampling)) {
+        synth.setOversampling(settings.oversampling);
+    }
+    if (changed & paramBit(ParamIndex::controlRate)) {
+        synth.controlPeriod = settings.controlPeriod;
+    }
+    if (changed & paramBit(ParamIndex::envAttack)) { synth.envAttack = settings.envAttack; }
+    if (changed & paramBit(ParamIndex::envDecay)) { synth.envDecay = settings.envDecay; }
+    if (changed & paramBit(ParamIndex::envSustain)) { synth.envSustain = settings.envSustain; }
+    if (changed & paramBit(ParamIndex::envRelease)) { synth.envRelease = settings.envRelease; }
+    if (changed & paramBit(ParamIndex::noise)) {
+        synth.noiseMixSmoother.setTargetValue(settings.noiseMix);
+    }
+    if (changed & paramBit(ParamIndex::oscMix)) {
+        synth.oscMixSmoother.setTargetValue(settings.oscMix);
+    }
+    if (changed & (paramBit(ParamIndex::oscTune) | paramBit(ParamIndex::oscFine))) {
+        synth.detune = settings.detune;
+    }
+    if (changed & (paramBit(ParamIndex::octave) | paramBit(ParamIndex::tuning))) {
+        synth.tune = settings.tune;
+    }
+    if (changed & paramBit(ParamIndex::polyMode)) { synth.numVoices = settings.numVoices; }
+    if (changed & paramBit(ParamIndex::oscEngine)) { synth.polyBLEP = settings.polyBLEP; }
+    if (changed & paramBit(ParamIndex::outputLevel)) {
+        synth.outputLevelSmoother.setTargetValue(settings.outputLevel);
+    }
+    if (changed & paramBit(ParamIndex::filterVelocity)) {
+        synth.velocitySensitivity = settings.velocitySensitivity;
+        synth.ignoreVelocity = settings.ignoreVelocity;
+    }
+    if (changed & paramBit(ParamIndex::lfoRate)) { synth.lfoInc = settings.lfoInc; }
+    if (changed & paramBit(ParamIndex::vibrato)) {
+        synth.vibrato = settings.vibrato;
+        synth.pwmDepth = settings.pwmDepth;
+    }
+    if (changed & paramBit(ParamIndex::glideMode)) { synth.glideMode = settings.glideMode; }
+    if (changed & paramBit(ParamIndex::glideRate)) { synth.glideRate = settings.glideRate; }
+    if (changed & paramBit(ParamIndex::glideBend)) { synth.glideBend = settings.glideBend; }
+    if (changed & paramBit(ParamIndex::filterFreq)) {
+        synth.filterKeyTrackingSmoother.setTargetValue(settings.filterKeyTracking);
+    }
+    if (changed & paramBit(ParamIndex::filterReso)) {
+        synth.filterQSmoother.setTargetValue(settings.filterQ);
+    }
+    if (changed & (paramBit(ParamIndex::oscMix) | paramBit(ParamIndex::noise) | paramBit(ParamIndex::filterReso))) {
+        synth.volumeTrim = settings.volumeTrim;
+    }
+    if (changed & paramBit(ParamIndex::filterLFO)) { synth.filterLFODepth = settings.filterLFODepth; }
+    if (changed & paramBit(ParamIndex::filterAttack)) { synth.filterAttack = settings.filterAttack; }
+    if (changed & paramBit(ParamIndex::filterDecay)) { synth.filterDecay = settings.filterDecay; }
+    if (changed & paramBit(ParamIndex::filterSustain)) { synth.filterSustain = settings.filterSustain; }
+    if (changed & paramBit(ParamIndex::filterRelease)) { synth.filterRelease = settings.filterRelease; }
+    if (changed & paramBit(ParamIndex::filterEnv)) { synth.filterEnvDepth = settings.filterEnvDepth; }
+}
+
+SynthSettings captureSettings(const Synth& synth)
+{
+    SynthSettings settings;
+    settings.oversampling = synth.getOversampling();
+    settings.controlPeriod = synth.controlPeriod;
+    settings.envAttack = synth.envAttack;
+    settings.envDecay = synth.envDecay;
+    settings.envSustain = synth.envSustain;
+    settings.envRelease = synth.envRelease;
+    settings.noiseMix = synth.noiseMixSmoother.getTargetValue();
+    settings.oscMix = synth.oscMixSmoother.getTargetValue();
+    settings.detune = synth.detune;
+    settings.tune = synth.tune;
+    settings.numVoices = synth.numVoices;
+    settings.polyBLEP = synth.polyBLEP;
+    settings.outputLevel = synth.outputLevelSmoother.getTargetValue();
+    settings.velocitySensitivity = synth.velocitySensitivity;
+    settings.ignoreVelocity = synth.ignoreVelocity;
+    settings.lfoInc = synth.lfoInc;
+    settings.vibrato = synth.vibrato;
+    settings.pwmDepth = synth.pwmDepth;
+    settings.glideMode = synth.glideMode;
+    settings.glideRate = synth.glideRate;
+    settings.glideBend = synth.glideBend;
+    settings.filterKeyTracking = synth.filterKeyTrackingSmoother.getTargetValue();
+    settings.filterQ = synth.filterQSmoother.getTargetValue();
+    settings.volumeTrim = synth.volumeTrim;
+    settings.filterLFODepth = synth.filterLFODepth;
+    settings.filterAttack = synth.filterAttack;
+    settings.filterDecay = synth.filterDecay;
+    settings.filterSustain = synth.filterSustain;
+    settings.filterRelease = synth.filterRelease;
+    settings.filterEnvDepth = synth.filterEnvDepth;
+    return settings;
+}
+
+void applyParameters(Synth& synth, const float* values, float sampleRate, uint32_t changed)
+{
+    // Start from the synth's current settings, so that the settings for the
+    // parameters that didn't change stay the same.
+    SynthSettings settings = captureSettings(synth);
+    changed = updateSettings(settings, values, sampleRate, changed);
+    applySettings(synth, settings, changed);
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "Preset.h"
+
+class Synth;
+
+namespace ParameterID
+{
+    #define PARAMETER_ID(str) const juce::ParameterID str(#str, 1);
+
+    PARAMETER_ID(oscMix)
+    PARAMETER_ID(oscTune)
+    PARAMETER_ID(oscFine)
+    PARAMETER_ID(glideMode)
+    PARAMETER_ID(glideRate)
+    PARAMETER_ID(glideBend)
+    PARAMETER_ID(filterFreq)
+    PARAMETER_ID(filterReso)
+    PARAMETER_ID(filterEnv)
+    PARAMETER_ID(filterLFO)
+    PARAMETER_ID(filterVelocity)
+    PARAMETER_ID(filterAttack)
+    PARAMETER_ID(filterDecay)
+    PARAMETER_ID(filterSustain)
+    PARAMETER_ID(filterRelease)
+    PARAMETER_ID(envAttack)
+    PARAMETER_ID(envDecay)
+    PARAMETER_ID(envSustain)
+    PARAMETER_ID(envRelease)
+    PARAMETER_ID(lfoRate)
+    PARAMETER_ID(vibrato)
+    PARAMETER_ID(noise)
+    PARAMETER_ID(octave)
+    PARAMETER_ID(tuning)
+    PARAMETER_ID(outputLevel)
+    PARAMETER_ID(polyMode)
+    PARAMETER_ID(oscEngine)
+    PARAMETER_ID(controlRate)
+    PARAMETER_ID(oversampling)
+
+    // Not part of the presets, see QualityProfile, applyStealingChoice and
+    // midiToleranceForChoice.
+    PARAMETER_ID(quality)
+    PARAMETER_ID(voiceStealing)
+    PARAMETER_ID(midiTiming)
+    PARAMETER_ID(programChange)
+    PARAMETER_ID(workerThreads)
+
+    #undef PARAMETER_ID
+}
+
+// Returns the ID of the parameter at the given ParamIndex.
+const juce::ParameterID& getParameterID(int index);
+
+// Bit masks that say which parameters have changed, one bit per ParamIndex.
+constexpr uint32_t paramBit(int index) { return 1u << index; }
+constexpr uint32_t ALL_PARAMS = (1u << NUM_PARAMS) - 1;
+static_assert(NUM_PARAMS <= 31, "too many parameters for the bit mask");
+
+// Length of the control period in samples for the Control Rate parameter.
+// `choice` is the index of the choice: 8, 16, 32 or 64 samples, or 1, 2 or
+// 4 kHz. The samples are at the host's `sampleRate`; the result is in
+// samples at the oversampled rate, so that the control rate in Hz does not
+// depend on the oversampling factor.
+int controlPeriodForChoice(int choice, float sampleRate, int oversampling);
+
+// The settings that trade sound quality for CPU time. A profile only
+// overrides the Control Rate, Osc Engine and Oversampling parameters that it
+// has a choice for, which is the index of the choice, and leaves the ones
+// that are KEEP alone. It always sets Synth::preciseMath.
+struct QualityProfile
+{
+    static constexpr int KEEP = -1;
+
+    const char* name;
+    int controlRate;
+    int oscEngine;
+    int oversampling;
+    bool preciseMath;
+};
+
+namespace QualityProfiles
+{
+    // For playing live. The parameters are used as they are, with the fast
+    // approximations. The factory presets are set up to be cheap this way.
+    const QualityProfile lean {
+        "Lean", QualityProfile::KEEP, QualityProfile::KEEP, QualityProfile::KEEP, false
+    };
+
+    // For rendering offline, when it doesn't matter how long it takes: the
+    // fastest control rate, 4x oversampling, and no approximations. The Osc
+    // Engine changes the character of the sound, so it's left alone.
+    const QualityProfile high { "High", 0, QualityProfile::KEEP, 2, true };
+}
+
+// The profile for the Quality parameter. `choice` is the index of the choice:
+// Auto, Lean or High. Auto picks High when the host renders offline, and Lean
+// when playing live.
+const QualityProfile& qualityProfileForChoice(int choice, bool offline);
+
+// The parameters that a quality profile may override.
+constexpr uint32_t QUALITY_PARAMS = paramBit(ParamIndex::controlRate)
+                                  | paramBit(ParamIndex::oscEngine)
+                                  | paramBit(ParamIndex::oversampling);
+
+// Puts the profile's settings into `values` and `synth`. Call this before
+// applyParameters. When switching to a different profile, add QUALITY_PARAMS
+// to the changed parameters.
+void applyQualityProfile(Synth& synth, const QualityProfile& profile, float* values);
+
+// Only puts the profile's settings into `values`, for the parameters that
+// it overrides.
+void setQualityValues(const QualityProfile& profile, float* values);
+
+// Sets Synth::stealPolicy for the Voice Stealing parameter. `choice` is the
+// index of the choice: quietest, oldest, same note, keep lowest note, or
+// keep highest note. All but oldest steal the quietest voice.
+void applyStealingChoice(Synth& synth, int choice);
+
+// How many samples EventScheduler may move the continuous controllers for the
+// MIDI Timing parameter. `choice` is the index of the choice: exact, 1 ms,
+// 3 ms or 10 ms.
+int midiToleranceForChoice(int choice, double sampleRate);
+
+// Converts the parameter values into the settings that Synth uses. `values`
+// has NUM_PARAMS values in the same order and units as Preset::param; choice
+// parameters hold the index of the choice. Only the settings that depend on
+// the parameters in `changed` are recalculated. `sampleRate` is the host's
+// sample rate, not the oversampled one.
+//
+// This is shared by the plug-in and the JX11Render command-line tool, so
+// that they make exactly the same sound.
+void applyParameters(Synth& synth, const float* values, float sampleRate, uint32_t changed);
+
+// Everything that applyParameters sets on the synth. The smoothed settings
+// are the values that the smoothers ramp to.
+struct SynthSettings
+{
+    int oversampling = 1;
+    int controlPeriod = 32;
+    float envAttack = 0.0f, envDecay = 0.0f, envSustain = 0.0f, envRelease = 0.0f;
+    float noiseMix = 0.0f;
+    float oscMix = 0.0f;
+    float detune = 1.0f;
+    float tune = 0.0f;
+    int numVoices = 1;
+    bool polyBLEP = false;
+    float outputLevel = 1.0f;
+    float velocitySensitivity = 0.0f;
+    bool ignoreVelocity = false;
+    float lfoInc = 0.0f;
+    float vibrato = 0.0f;
+    float pwmDepth = 0.0f;
+    int glideMode = 0;
+    float glideRate = 1.0f;
+    float glideBend = 0.0f;
+    float filterKeyTracking = 0.0f;
+    float filterQ = 1.0f;
+    float volumeTrim = 0.0f;
+    float filterLFODepth = 0.0f;
+    float filterAttack = 0.0f, filterDecay = 0.0f, filterSustain = 0.0f, filterRelease = 0.0f;
+    float filterEnvDepth = 0.0f;
+};
+
+// The two halves of applyParameters. updateSettings does all the math and
+// returns `changed` plus the parameters whose settings it had to recalculate
+// because they depend on others, such as the envelopes on the oversampling
+// factor. applySettings then copies those settings into the synth. This way
+// the settings for a preset can be calculated ahead of time, away from the
+// synth, and applied to it later in one go.
+uint32_t updateSettings(SynthSettings& settings, const float* values, float sampleRate, uint32_t changed);
+void applySettings(Synth& synth, const SynthSettings& settings, uint32_t changed);
+
+// The settings that the synth uses right now.
+SynthSettings captureSettings(const Synth& synth);
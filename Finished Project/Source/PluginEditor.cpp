@@ -9,17 +9,50 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+// Height of the status area below the parameters.
+static const int STATUS_HEIGHT = 184;
+
 //==============================================================================
 JX11AudioProcessorEditor::JX11AudioProcessorEditor (JX11AudioProcessor& p)
     : AudioProcessorEditor (&p), audioProcessor (p)
 {
-    // Make sure that before the constructor has finished, you've set the
-    // editor's size to whatever you need it to be.
-    setSize (400, 300);
+    addAndMakeVisible(parameterEditor);
+    addAndMakeVisible(qualityLabel);
+    addAndMakeVisible(loadLabel);
+    addAndMakeVisible(telemetryLabel);
+    addAndMakeVisible(saveButton);
+    addAndMakeVisible(clearButton);
+
+    saveButton.onClick = [this] { saveLoadReport(); };
+    clearButton.onClick = [this] { audioProcessor.getLoadMeter().clear(); };
+
+    // The item IDs are the ParamIndex plus one, because 0 means nothing.
+    juce::StringArray names = audioProcessor.getParameterNames();
+    for (int i = 0; i < names.size(); ++i) {
+        learnParameterBox.addItem(names[i], i + 1);
+    }
+    learnParameterBox.setSelectedId(1);
+
+    addAndMakeVisible(learnParameterBox);
+    addAndMakeVisible(learnFineButton);
+    addAndMakeVisible(learnButton);
+    addAndMakeVisible(forgetButton);
+    addAndMakeVisible(midiLearnLabel);
+
+    learnButton.onClick = [this] { learnButtonClicked(); };
+    forgetButton.onClick = [this] {
+        audioProcessor.forgetMidiLearn(learnParameterBox.getSelectedId() - 1);
+    };
+
+    timerCallback();
+    startTimerHz(4);
+
+    setSize (500, 1050 + STATUS_HEIGHT);
 }
 
 JX11AudioProcessorEditor::~JX11AudioProcessorEditor()
 {
+    audioProcessor.cancelMidiLearn();
 }
 
 //==============================================================================
@@ -27,14 +60,73 @@ void JX11AudioProcessorEditor::paint (juce::Graphics& g)
 {
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
-
-    g.setColour (juce::Colours::white);
-    g.setFont (15.0f);
-    g.drawFittedText ("Hello World!", getLocalBounds(), juce::Justification::centred, 1);
 }
 
 void JX11AudioProcessorEditor::resized()
 {
-    // This is generally where you'll want to lay out the positions of any
-    // subcomponents in your editor..
+    auto bounds = getLocalBounds();
+    auto status = bounds.removeFromBottom(STATUS_HEIGHT).reduced(8, 4);
+    parameterEditor.setBounds(bounds);
+
+    midiLearnLabel.setBounds(status.removeFromBottom(24));
+    auto learn = status.removeFromBottom(24);
+    learnParameterBox.setBounds(learn.removeFromLeft(160));
+    learn.removeFromLeft(8);
+    learnFineButton.setBounds(learn.removeFromLeft(70));
+    learn.removeFromLeft(8);
+    learnButton.setBounds(learn.removeFromLeft(100));
+    learn.removeFromLeft(8);
+    forgetButton.setBounds(learn.removeFromLeft(70));
+    status.removeFromBottom(8);
+
+    auto buttons = status.removeFromBottom(24);
+    saveButton.setBounds(buttons.removeFromLeft(140));
+    buttons.removeFromLeft(8);
+    clearButton.setBounds(buttons.removeFromLeft(100));
+
+    qualityLabel.setBounds(status.removeFromTop(24));
+    loadLabel.setBounds(status.removeFromTop(24));
+    telemetryLabel.setBounds(status);
+}
+
+void JX11AudioProcessorEditor::timerCallback()
+{
+    qualityLabel.setText(audioProcessor.getQualitySummary(), juce::dontSendNotification);
+    loadLabel.setText(audioProcessor.getLoadMeter().getSummary(), juce::dontSendNotification);
+
+    const TelemetryTotals& totals = audioProcessor.getTelemetryTotals();
+    telemetryLabel.setText("Voices peak " + juce::String(totals.peakVoices.load())
+                           + "  stolen " + juce::String(int(totals.voicesStolen.load()))
+                           + "  output problems " + juce::String(int(totals.outputProblems.load()))
+                           + "  parameter updates " + juce::String(int(totals.parameterUpdates.load()))
+                           + "\nMIDI ignored " + juce::String(int(totals.midiIgnored.load()))
+                           + "  dropped " + juce::String(int(totals.midiDropped.load())),
+                           juce::dontSendNotification);
+
+    learnButton.setButtonText(audioProcessor.isMidiLearning() ? "Waiting..." : "MIDI Learn");
+    midiLearnLabel.setText(audioProcessor.getMidiLearnSummary(), juce::dontSendNotification);
+}
+
+void JX11AudioProcessorEditor::learnButtonClicked()
+{
+    // Clicking again while waiting for a controller cancels.
+    if (audioProcessor.isMidiLearning()) {
+        audioProcessor.cancelMidiLearn();
+    } else {
+        audioProcessor.startMidiLearn(learnParameterBox.getSelectedId() - 1,
+                                      learnFineButton.getToggleState());
+    }
+    timerCallback();
+}
+
+void JX11AudioProcessorEditor::saveLoadReport()
+{
+    auto file = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                    .getChildFile("JX11 Load Report.csv");
+    bool saved = audioProcessor.saveLoadReport(file);
+    juce::AlertWindow::showMessageBoxAsync(saved ? juce::MessageBoxIconType::InfoIcon
+                                                 : juce::MessageBoxIconType::WarningIcon,
+                                           "Save Load Report",
+                                           (saved ? "Saved to " : "Could not write ")
+                                               + file.getFullPathName());
 }
@@ -13,8 +13,11 @@
 
 //==============================================================================
 /**
+    The generic editor for the parameters, with a status area below it that
+    shows which parameters the quality profile overrides, the CPU load and
+    the telemetry totals, and the MIDI learn controls.
 */
-class JX11AudioProcessorEditor  : public juce::AudioProcessorEditor
+class JX11AudioProcessorEditor  : public juce::AudioProcessorEditor, private juce::Timer
 {
 public:
     JX11AudioProcessorEditor (JX11AudioProcessor&);
@@ -25,9 +28,33 @@ public:
     void resized() override;
 
 private:
+    void timerCallback() override;
+    void saveLoadReport();
+    void learnButtonClicked();
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     JX11AudioProcessor& audioProcessor;
 
+    // The sliders and menus for all the parameters.
+    juce::GenericAudioProcessorEditor parameterEditor { audioProcessor };
+
+    // Updated a few times per second from the quality profile, the load
+    // meter and the telemetry.
+    juce::Label qualityLabel;
+    juce::Label loadLabel;
+    juce::Label telemetryLabel;
+
+    juce::TextButton saveButton { "Save Load Report" };
+    juce::TextButton clearButton { "Clear Load" };
+
+    // Pick a parameter, then move a knob on the MIDI controller. With 14-bit,
+    // a controller from 0 - 31 is paired with the one 32 higher.
+    juce::ComboBox learnParameterBox;
+    juce::ToggleButton learnFineButton { "14-bit" };
+    juce::TextButton learnButton { "MIDI Learn" };
+    juce::TextButton forgetButton { "Forget" };
+    juce::Label midiLearnLabel;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (JX11AudioProcessorEditor)
 };
@@ -49,16 +49,73 @@ JX11AudioProcessor::JX11AudioProcessor()
     castParameter(apvts, ParameterID::tuning, tuningParam);
     castParameter(apvts, ParameterID::outputLevel, outputLevelParam);
     castParameter(apvts, ParameterID::polyMode, polyModeParam);
+    castParameter(apvts, ParameterID::oscEngine, oscEngineParam);
+    castParameter(apvts, ParameterID::controlRate, controlRateParam);
+    castParameter(apvts, ParameterID::oversampling, oversamplingParam);
+    castParameter(apvts, ParameterID::quality, qualityParam);
+    castParameter(apvts, ParameterID::voiceStealing, voiceStealingParam);
+    castParameter(apvts, ParameterID::midiTiming, midiTimingParam);
+    castParameter(apvts, ParameterID::programChange, programChangeParam);
+    castParameter(apvts, ParameterID::workerThreads, workerThreadsParam);
+
+    juce::RangedAudioParameter* allParams[NUM_PARAMS] = {
+        oscMixParam,
+        oscTuneParam,
+        oscFineParam,
+        glideModeParam,
+        glideRateParam,
+        glideBendParam,
+        filterFreqParam,
+        filterResoParam,
+        filterEnvParam,
+        filterLFOParam,
+        filterVelocityParam,
+        filterAttackParam,
+        filterDecayParam,
+        filterSustainParam,
+        filterReleaseParam,
+        envAttackParam,
+        envDecayParam,
+        envSustainParam,
+        envReleaseParam,
+        lfoRateParam,
+        vibratoParam,
+        noiseParam,
+        octaveParam,
+        tuningParam,
+        outputLevelParam,
+        polyModeParam,
+        oscEngineParam,
+        controlRateParam,
+        oversamplingParam,
+    };
 
-    createPrograms();
+    for (int i = 0; i < NUM_PARAMS; ++i) {
+        params[i] = allParams[i];
+        lastParamValues[i] = -1.0f;  // force an update on the first block
+    }
+
+    lastQualityChoice = qualityParam->getIndex();
+    qualityProfile = chooseQualityProfile();
+
+    createFactoryPresets(presets);
     setCurrentProgram(0);
 
-    apvts.state.addListener(this);
+    // Passes the program and volume changes from MIDI on to the host.
+    startTimerHz(30);
+
+    // Set the environment variable JX11_TELEMETRY_LOG to the name of a file
+    // to log what happens on the audio thread. Every plug-in writes its own
+    // file next to it, see TelemetryLogger.
+    juce::String logPath = juce::SystemStats::getEnvironmentVariable("JX11_TELEMETRY_LOG", {});
+    telemetryLogger.start(logPath.isNotEmpty()
+                          ? juce::File::getCurrentWorkingDirectory().getChildFile(logPath)
+                          : juce::File());
 }
 
 JX11AudioProcessor::~JX11AudioProcessor()
 {
-    apvts.state.removeListener(this);
+    stopTimer();
 }
 
 //==============================================================================
@@ -112,45 +169,20 @@ int JX11AudioProcessor::getCurrentProgram()
 void JX11AudioProcessor::setCurrentProgram (int index)
 {
     currentProgram = index;
+    setPresetParameters(index);
 
-    juce::RangedAudioParameter *params[NUM_PARAMS] = {
-        oscMixParam,
-        oscTuneParam,
-        oscFineParam,
-        glideModeParam,
-        glideRateParam,
-        glideBendParam,
-        filterFreqParam,
-        filterResoParam,
-        filterEnvParam,
-        filterLFOParam,
-        filterVelocityParam,
-        filterAttackParam,
-        filterDecayParam,
-        filterSustainParam,
-        filterReleaseParam,
-        envAttackParam,
-        envDecayParam,
-        envSustainParam,
-        envReleaseParam,
-        lfoRateParam,
-        vibratoParam,
-        noiseParam,
-        octaveParam,
-        tuningParam,
-        outputLevelParam,
-        polyModeParam,
-    };
+    // The audio thread switches the synth over at the start of the next
+    // block, see changeProgram.
+    pendingProgram.store(index, std::memory_order_release);
+}
 
-    const Preset& preset = presets[index];
+void JX11AudioProcessor::setPresetParameters(int index)
+{
+    const Preset& preset = presets[size_t(index)];
 
     for (int i = 0; i < NUM_PARAMS; ++i) {
       params[i]->setValueNotifyingHost(params[i]->convertTo0to1(preset.param[i]));
     }
-
-    // This is needed because changing presets while playing notes may need to
-    // invalid filter states etc, which can give nan or inf in the audio buffer.
-    reset();
 }
 
 const juce::String JX11AudioProcessor::getProgramName (int index)
@@ -166,20 +198,41 @@ void JX11AudioProcessor::changeProgramName (int /*index*/, const juce::String& /
 //==============================================================================
 void JX11AudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
+    synth.numWorkerThreads = chooseNumWorkerThreads();
     synth.allocateResources(sampleRate, samplesPerBlock);
-    parametersChanged.store(true);
+    prepared = true;
     reset();
+    prepareProgramSettings();
+
+    // The oversampling delays the output. Hosts with delay compensation use
+    // the latency to start this plug-in earlier.
+    synthLatency.store(synth.getLatency(), std::memory_order_relaxed);
+    setLatencySamples(synth.getLatency());
 }
 
 void JX11AudioProcessor::releaseResources()
 {
+    prepared = false;
     synth.deallocateResources();
 }
 
 void JX11AudioProcessor::reset()
 {
+    // Apply the current parameter values first. Synth::reset makes the
+    // smoothers jump to these values, so they don't ramp up from the old
+    // values. Before prepareToPlay there is no sample rate yet.
+    if (getSampleRate() > 0.0) {
+        changedParameters();  // remember the values, so processBlock skips update
+        lastQualityChoice = qualityParam->getIndex();
+        qualityProfile = chooseQualityProfile();
+        update(ALL_PARAMS);
+
+        // The parameters already hold the new program, if there is one. A
+        // program change from MIDI that they don't have yet is undone.
+        pendingProgram.store(-1, std::memory_order_relaxed);
+        midiProgram = -1;
+    }
     synth.reset();
-    synth.outputLevelSmoother.setCurrentAndTargetValue(juce::Decibels::decibelsToGain(outputLevelParam->get()));
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -210,6 +263,8 @@ bool JX11AudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) con
 
 void JX11AudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    const int64_t startTicks = juce::Time::getHighResolutionTicks();
+
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -219,211 +274,418 @@ void JX11AudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::M
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    // Only recalculate when a parameter has changed.
-    bool expected = true;
-    if (parametersChanged.compare_exchange_strong(expected, false)) {
-        update();
+    // The message thread has put a program change from MIDI into the
+    // parameters. The synth already has it, or an even newer one that the
+    // parameters will get soon. But if the synth was reset to the parameters
+    // in the meantime, it still needs the new values.
+    int synced = syncedProgram.exchange(-1, std::memory_order_acquire);
+    if (synced >= 0 && midiProgram >= 0) {
+        rememberPresetValues(synced);
+        if (synced == midiProgram) {
+            midiProgram = -1;
+        }
     }
 
-    splitBufferByEvents(buffer, midiMessages);
+    // The host or the editor chose a program.
+    int program = pendingProgram.exchange(-1, std::memory_order_acquire);
+    if (program >= 0) {
+        rememberPresetValues(program);
+        changeProgram(program);
+        midiProgram = -1;
+    }
+
+    // Decode the MIDI messages once. Program changes and the volume
+    // controller change parameters, so they are handled before the
+    // parameters are read, and take effect from the start of this block.
+    synthEvents.clear();
+    hostEvents.clear();
+    const uint32_t ignoredBefore = synthEvents.getNumIgnored();
+    const uint32_t droppedBefore = synthEvents.getNumDropped() + hostEvents.getNumDropped();
+    const bool learning = midiLearnArmed.load(std::memory_order_relaxed);
+    synthEvents.addMidi(midiMessages, hostEvents, [&](const SynthEvent& event) {
+        return event.isForHost() || midiLearn.isMapped(event)
+            || (learning && event.type == SynthEvent::Type::controlChange
+                && MidiLearnTable::canLearn(event.number));
+    });
+    midiMessages.clear();
+
+    // Messages that the synth doesn't use, such as sysex, and events that
+    // didn't fit in the queues, so the editor and the log can show them.
+    const uint32_t ignored = synthEvents.getNumIgnored() - ignoredBefore;
+    const uint32_t dropped = synthEvents.getNumDropped() + hostEvents.getNumDropped() - droppedBefore;
+    if (ignored != 0 || dropped != 0) {
+        synth.telemetry.push({ TelemetryEvent::midiLost, int32_t(ignored), int32_t(dropped),
+                               synth.getSampleTime() });
+    }
+    handleHostEvents();
+
+    // Read the parameters on every block, so that automation also works when
+    // the host renders faster than realtime. But only recalculate the synth
+    // settings for the parameters that actually changed.
+    uint32_t changed = changedParameters();
+
+    // Choosing a different quality in the plug-in takes effect right away,
+    // just like changing any of the parameters it overrides. When the host
+    // switches between realtime and offline rendering, wait for a block that
+    // starts with no voices playing, so that the switch can't be heard.
+    const QualityProfile* profile = chooseQualityProfile();
+    int qualityChoice = qualityParam->getIndex();
+    if (profile != qualityProfile) {
+        if (qualityChoice != lastQualityChoice || synth.getNumActiveVoices() == 0) {
+            qualityProfile = profile;
+            changed |= QUALITY_PARAMS;
+        }
+    }
+    lastQualityChoice = qualityChoice;
+
+    // This is only a few flags, so simply copy it on every block.
+    applyStealingChoice(synth, voiceStealingParam->getIndex());
+    scheduler.setTolerance(midiToleranceForChoice(midiTimingParam->getIndex(), getSampleRate()));
+
+    int64_t updateTicks = 0;
+    if (changed != 0) {
+        const int64_t updateStart = juce::Time::getHighResolutionTicks();
+        update(changed);
+        updateTicks = juce::Time::getHighResolutionTicks() - updateStart;
+        synth.telemetry.push({ TelemetryEvent::parameterUpdate, int32_t(changed), 0,
+                               synth.getSampleTime() });
+    }
+
+    blockSegments = 0;
+    blockPeakVoices = 0;
+    renderTicks = 0;
+
+    // With nothing playing and no MIDI coming in, the whole block is silent.
+    // Clearing the entire buffer also sets its hasBeenCleared() flag, which
+    // lets the plug-in wrapper tell the host that the output is silent.
+    if (synthEvents.isEmpty() && synth.isIdle()) {
+        buffer.clear();
+        synth.skipSilence(buffer.getNumSamples());
+    } else {
+        splitBufferByEvents(buffer);
+
+        // Only blocks that do something are reported, so that an idle
+        // plug-in doesn't fill up the log.
+        synth.telemetry.push({ TelemetryEvent::block, blockSegments, blockPeakVoices,
+                               synth.getSampleTime() });
+    }
+
+    loadMeter.addBlock(juce::Time::getHighResolutionTicks() - startTicks, updateTicks, renderTicks,
+                       buffer.getNumSamples(), getSampleRate(), currentProgram, blockPeakVoices);
+
+    // The Oversampling parameter, the Quality parameter or a program change
+    // may have changed the latency. The timer passes it on to the host.
+    synthLatency.store(synth.getLatency(), std::memory_order_relaxed);
 }
 
-void JX11AudioProcessor::update()
+uint32_t JX11AudioProcessor::changedParameters()
 {
-    // This function is called from the audio callback whenever any of the
-    // parameters have changed. Here, we simply recalculate everything when
-    // this happens. This function is called at most once per audio block.
-    // It could be optimized to recalculate only the things that have changed,
-    // but doing the bookkeeping for that also has a cost. Still, it might be
-    // worth it for parameters that are heavily automated.
-
-    float sampleRate = float(getSampleRate());
-    float inverseSampleRate = 1.0f / sampleRate;
-
-    // The envelope is implemented using a simple one-pole filter, which creates
-    // an analog-style exponential curve. The formulas below calculate the filter
-    // coefficients for the attack, decay, and release stages.
-    synth.envAttack = std::exp(-inverseSampleRate * std::exp(5.5f - 0.075f * envAttackParam->get()));
-    synth.envDecay = std::exp(-inverseSampleRate * std::exp(5.5f - 0.075f * envDecayParam->get()));
-
-    synth.envSustain = envSustainParam->get() / 100.0f;
-
-    float envRelease = envReleaseParam->get();
-    if (envRelease < 1.0f) {
-        synth.envRelease = 0.75f;  // extra fast release
-    } else {
-        synth.envRelease = std::exp(-inverseSampleRate * std::exp(5.5f - 0.075f * envRelease));
-    }
-
-    // How much noise to mix into the signal. This is a parabolic curve,
-    // similar to creating a parameter with skew = 0.5.
-    float noiseMix = noiseParam->get() / 100.0f;
-    noiseMix *= noiseMix;
-    synth.noiseMix = noiseMix * 0.06f;
-
-    // How much to mix osc2 into the output. This is a value between 0 and 1.
-    synth.oscMix = oscMixParam->get() / 100.0f;
-
-    // Calculate the multiplication factor for detuning oscillator 2. This is
-    // the same as 2^(N/12) where N is the number of (fractional) semitones.
-    // This value will be multiplied with the oscillator period, which is why
-    // detuning down is greater than 1, as lowering the pitch means the period
-    // becomes longer. Vice versa for going up in pitch.
-    float semi = oscTuneParam->get();
-    float cent = oscFineParam->get();
-    synth.detune = std::pow(1.059463094359f, -semi - 0.01f * cent);
-
-    // Master tuning. See the book for a full explanation of what happens here.
-    float octave = octaveParam->get();  // -2 to +2
-    float tuning = tuningParam->get();  // -100 to +100
-    float tuneInSemi = -36.3763f - 12.0f * octave - tuning / 100.0f;
-    synth.tune = sampleRate * std::exp(0.05776226505f * tuneInSemi);
-
-    // Mono or poly?
-    synth.numVoices = (polyModeParam->getIndex() == 0) ? 1 : Synth::MAX_VOICES;
-
-    // Convert decibels to gain. Use a smoother for this parameter.
-    synth.outputLevelSmoother.setTargetValue(juce::Decibels::decibelsToGain(outputLevelParam->get()));
-
-    // Filter velocity sensitivity, a value between -0.05 and +0.05.
-    // If disabled, the velocity is completely ignored.
-    float filterVelocity = filterVelocityParam->get();
-    if (filterVelocity < -90.0f) {
-        synth.velocitySensitivity = 0.0f;  // turn off velocity
-        synth.ignoreVelocity = true;
-    } else {
-        synth.velocitySensitivity = 0.0005f * filterVelocity;
-        synth.ignoreVelocity = false;
-    }
-
-    // Use a lower update rate for the glide and filter envelope, 32 times
-    // (= LFO_MAX) slower than the sample rate.
-    const float inverseUpdateRate = inverseSampleRate * synth.LFO_MAX;
-
-    // The LFO rate is an exponentional curve that maps the 0 - 1 parameter
-    // value to 0.018 Hz - 20.09 Hz. Use this to calculate the phase increment
-    // for a sine wave running at 1/32th the sample rate.
-    float lfoRate = std::exp(7.0f * lfoRateParam->get() - 4.0f);
-    synth.lfoInc = lfoRate * inverseUpdateRate * float(TWO_PI);
-
-    // The vibrato parameter is a parabolic curve going from 0.0 for 0% up to
-    // 0.05 for 100%. You can choose between PWM mode (to the left) and vibrato
-    // mode (to the right). These values are used as the amplitude of the LFO
-    // sine wave that modulates the oscillator periods.
-    float vibrato = vibratoParam->get() / 200.0f;
-    synth.vibrato = 0.2f * vibrato * vibrato;
-    synth.pwmDepth = synth.vibrato;
-    if (vibrato < 0.0f) { synth.vibrato = 0.0f; }
-
-    // Need to glide?
-    synth.glideMode = glideModeParam->getIndex();
-
-    // Just like the envelope, glide is implemented using a one-pole filter
-    // that is updated every 32 samples. Here we set the filter coefficient.
-    // A smaller coefficient means the glide takes longer.
-    float glideRate = glideRateParam->get();
-    if (glideRate < 2.0f) {
-        synth.glideRate = 1.0f;  // no glide
-    } else {
-        synth.glideRate = 1.0f - std::exp(-inverseUpdateRate * std::exp(6.0f - 0.07f * glideRate));
+    uint32_t changed = 0;
+    for (int i = 0; i < NUM_PARAMS; ++i) {
+        float value = params[i]->getValue();
+        if (value != lastParamValues[i]) {
+            lastParamValues[i] = value;
+            changed |= paramBit(i);
+        }
     }
+    return changed;
+}
 
-    // Glide bend goes from -36 semitones to +36 semitones.
-    synth.glideBend = glideBendParam->get();
+void JX11AudioProcessor::update(uint32_t changed)
+{
+    // This function is called from the audio callback whenever any of the
+    // parameters have changed. The conversion from the parameter values to
+    // the synth's settings happens in applyParameters, which is shared with
+    // the JX11Render command-line tool.
+    float values[NUM_PARAMS];
+    readParameterValues(values);
+
+    applyQualityProfile(synth, *qualityProfile, values);
+    applyParameters(synth, values, float(getSampleRate()), changed);
+}
 
-    // The filter's cutoff is set using the note's pitch and velocity. This
-    // parameter shifts that cutoff up or down. Values are from -1.5 to 6.5.
-    synth.filterKeyTracking = 0.08f * filterFreqParam->get() - 1.5f;
+void JX11AudioProcessor::readParameterValues(float* values) const
+{
+    values[ParamIndex::oscMix] = oscMixParam->get();
+    values[ParamIndex::oscTune] = oscTuneParam->get();
+    values[ParamIndex::oscFine] = oscFineParam->get();
+    values[ParamIndex::glideMode] = float(glideModeParam->getIndex());
+    values[ParamIndex::glideRate] = glideRateParam->get();
+    values[ParamIndex::glideBend] = glideBendParam->get();
+    values[ParamIndex::filterFreq] = filterFreqParam->get();
+    values[ParamIndex::filterReso] = filterResoParam->get();
+    values[ParamIndex::filterEnv] = filterEnvParam->get();
+    values[ParamIndex::filterLFO] = filterLFOParam->get();
+    values[ParamIndex::filterVelocity] = filterVelocityParam->get();
+    values[ParamIndex::filterAttack] = filterAttackParam->get();
+    values[ParamIndex::filterDecay] = filterDecayParam->get();
+    values[ParamIndex::filterSustain] = filterSustainParam->get();
+    values[ParamIndex::filterRelease] = filterReleaseParam->get();
+    values[ParamIndex::envAttack] = envAttackParam->get();
+    values[ParamIndex::envDecay] = envDecayParam->get();
+    values[ParamIndex::envSustain] = envSustainParam->get();
+    values[ParamIndex::envRelease] = envReleaseParam->get();
+    values[ParamIndex::lfoRate] = lfoRateParam->get();
+    values[ParamIndex::vibrato] = vibratoParam->get();
+    values[ParamIndex::noise] = noiseParam->get();
+    values[ParamIndex::octave] = octaveParam->get();
+    values[ParamIndex::tuning] = tuningParam->get();
+    values[ParamIndex::outputLevel] = outputLevelParam->get();
+    values[ParamIndex::polyMode] = float(polyModeParam->getIndex());
+    values[ParamIndex::oscEngine] = float(oscEngineParam->getIndex());
+    values[ParamIndex::controlRate] = float(controlRateParam->getIndex());
+    values[ParamIndex::oversampling] = float(oversamplingParam->getIndex());
+}
 
-    // Filter Q. Starts at 1 and goes up to 20, approximately.
-    float filterReso = filterResoParam->get() / 100.0f;
-    synth.filterQ = std::exp(3.0f * filterReso);
+void JX11AudioProcessor::prepareProgramSettings()
+{
+    // The settings are calculated from the values that the parameters will
+    // have after setCurrentProgram, which may be rounded to the parameter's
+    // steps, so that they are the same as what update would calculate.
+    //
+    // This is done for every quality profile, so that a program change is
+    // just as quick after the Quality parameter changed, or after Auto
+    // switched to offline rendering.
+    for (auto& settings : programSettings) {
+        settings.presets.resize(presets.size());
+
+        for (size_t p = 0; p < presets.size(); ++p) {
+            float values[NUM_PARAMS];
+            for (int i = 0; i < NUM_PARAMS; ++i) {
+                float value = presets[p].param[i];
+                values[i] = params[i]->convertFrom0to1(params[i]->convertTo0to1(value));
+            }
+            setQualityValues(*settings.profile, values);
+            settings.presets[p] = SynthSettings();
+            updateSettings(settings.presets[p], values, float(getSampleRate()), ALL_PARAMS);
+        }
+    }
+}
 
-    // Self-oscillation:
-    //synth.filterQ = 1.0f / ((1.0f - filterReso + 1e-9) * (1.0f - filterReso + 1e-9));
+void JX11AudioProcessor::rememberPresetValues(int index)
+{
+    // The values that the parameters have after setPresetParameters, which
+    // may be rounded to the parameter's steps.
+    const Preset& preset = presets[size_t(index)];
+    for (int i = 0; i < NUM_PARAMS; ++i) {
+        float value = params[i]->convertFrom0to1(params[i]->convertTo0to1(preset.param[i]));
+        lastParamValues[i] = params[i]->convertTo0to1(value);
+    }
+}
 
-    // When using both oscillators, and/or noise or large filter resonance,
-    // the overall gain increases. This variable tries to compensate for that.
-    // There is also a manual output level control, as the total volume also
-    // depends on how many notes are playing, their envelopes, velocities, etc.
-    synth.volumeTrim = 0.0008f * (3.2f - synth.oscMix - 25.0f * synth.noiseMix) * (1.5f - 0.5f * filterReso);
+void JX11AudioProcessor::changeProgram(int index)
+{
+    // Copying the settings that prepareProgramSettings calculated is much
+    // quicker than calculating them, which takes dozens of calls to exp.
+    // They are only valid for the quality profile they were made with.
+    const SynthSettings* settings = nullptr;
+    for (const auto& profileSettings : programSettings) {
+        if (profileSettings.profile == qualityProfile && size_t(index) < profileSettings.presets.size()) {
+            settings = &profileSettings.presets[size_t(index)];
+        }
+    }
 
-    // Filter LFO intensity. Parabolic curve from 0 to 2.5.
-    float filterLFO = filterLFOParam->get() / 100.0f;
-    synth.filterLFODepth = 2.5f * filterLFO * filterLFO;
+    if (settings != nullptr) {
+        applySettings(synth, *settings, ALL_PARAMS);
+    } else {
+        update(ALL_PARAMS);
+    }
 
-    // The filter envelope uses the same formulas as the amplitude envelope
-    // but runs 32 times slower, at the same update rate as the LFO.
-    synth.filterAttack = std::exp(-inverseUpdateRate * std::exp(5.5f - 0.075f * filterAttackParam->get()));
-    synth.filterDecay = std::exp(-inverseUpdateRate * std::exp(5.5f - 0.075f * filterDecayParam->get()));
+    // Reset silences the voices and makes the smoothers jump to the new
+    // values. Smooth lets the notes that are playing carry on, while the
+    // smoothed settings glide to the new preset, so there is no click.
+    if (programChangeParam->getIndex() == 0) {
+        synth.reset();
+    }
+}
 
-    float filterSustain = filterSustainParam->get() / 100.0f;
-    synth.filterSustain = filterSustain * filterSustain;
+const QualityProfile* JX11AudioProcessor::chooseQualityProfile() const
+{
+    return &qualityProfileForChoice(qualityParam->getIndex(), isNonRealtime());
+}
 
-    synth.filterRelease = std::exp(-inverseUpdateRate * std::exp(5.5f - 0.075f * filterReleaseParam->get()));
+juce::String JX11AudioProcessor::getQualitySummary() const
+{
+    const QualityProfile& profile = *chooseQualityProfile();
+    juce::StringArray overridden;
+    if (profile.controlRate != QualityProfile::KEEP) {
+        overridden.add(params[ParamIndex::controlRate]->getName(32));
+    }
+    if (profile.oscEngine != QualityProfile::KEEP) {
+        overridden.add(params[ParamIndex::oscEngine]->getName(32));
+    }
+    if (profile.oversampling != QualityProfile::KEEP) {
+        overridden.add(params[ParamIndex::oversampling]->getName(32));
+    }
 
-    // Filter envelope intensity. Linear curve from -6.0 to +6.0.
-    synth.filterEnvDepth = 0.06f * filterEnvParam->get();
+    juce::String text = "Quality " + juce::String(profile.name);
+    if (overridden.isEmpty()) {
+        return text + ", uses the parameters as they are";
+    }
+    return text + ", ignores the " + overridden.joinIntoString(" and ") + " parameters";
 }
 
-void JX11AudioProcessor::splitBufferByEvents(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+void JX11AudioProcessor::splitBufferByEvents(juce::AudioBuffer<float>& buffer)
 {
-    int bufferOffset = 0;
+    // Loop through the events, which are sorted by their position inside the
+    // current audio buffer. Render the audio up to each event, handle the
+    // event, and continue rendering. The scheduler gathers the continuous
+    // controllers on control step boundaries so that a stream of them
+    // doesn't chop the block into tiny pieces.
+    scheduler.process(synth, synthEvents, buffer.getNumSamples(),
+        [&](int bufferOffset, int sampleCount) {
+            render(buffer, sampleCount, bufferOffset);
+        },
+        [&](const SynthEvent& event) {
+            synth.handleEvent(event);
+        });
+}
 
-    // Loop through the MIDI messages, which are sorted by samplePosition,
-    // the relative timestamp inside the current audio buffer.
-    for (const auto metadata : midiMessages) {
+void JX11AudioProcessor::handleHostEvents()
+{
+    // The synth changes right away, but the parameters can only be changed on
+    // the message thread, because that calls into the host. Until then, the
+    // parameters keep their old values and changedParameters doesn't see a
+    // difference, so the synth doesn't change back.
+    //
+    // HostChanges keeps only the last change of each kind. The benchmark in
+    // JX11Bench times this same code.
+    HostChanges changes;
+    for (const SynthEvent& event : hostEvents) {
+        if (changes.add(event, int(presets.size()))) {
+            continue;
+        }
+
+        // Control Change for MIDI learn
+        if (event.type == SynthEvent::Type::controlChange) {
+            int parameter;
+            float value;
+            if (midiLearnArmed.load(std::memory_order_relaxed)
+                    && MidiLearnTable::canLearn(event.number)
+                    && midiLearnArmed.exchange(false, std::memory_order_relaxed)) {
+                learnedController.store(event.number, std::memory_order_release);
+            } else if (midiLearn.handle(event, parameter, value)) {
+                changes.changeParameter(parameter, value);
+            }
+        }
+    }
+
+    if (changes.program >= 0) {
+        currentProgram = changes.program;
+        midiProgram = changes.program;
+        changeProgram(changes.program);
+    }
+    if (changes.changed != 0) {
+        changeParameters(changes.normalized, changes.changed);
+    }
+    changes.notify(hostNotifications);
+}
 
-        // Render the audio that happens before this event (if any).
-        int samplesThisSegment = metadata.samplePosition - bufferOffset;
-        if (samplesThisSegment > 0) {
-            render(buffer, samplesThisSegment, bufferOffset);
-            bufferOffset += samplesThisSegment;
+void JX11AudioProcessor::changeParameters(const float* normalized, uint32_t changed)
+{
+    float values[NUM_PARAMS];
+    readParameterValues(values);
+    for (int i = 0; i < NUM_PARAMS; ++i) {
+        if (changed & paramBit(i)) {
+            values[i] = params[i]->convertFrom0to1(normalized[i]);
         }
+    }
+    setQualityValues(*qualityProfile, values);
+    applyParameters(synth, values, float(getSampleRate()), changed);
+}
 
-        // Handle the event. Ignore MIDI messages such as sysex.
-        if (metadata.numBytes <= 3) {
-            uint8_t data1 = (metadata.numBytes >= 2) ? metadata.data[1] : 0;
-            uint8_t data2 = (metadata.numBytes == 3) ? metadata.data[2] : 0;
-            handleMIDI(metadata.data[0], data1, data2);
+void JX11AudioProcessor::timerCallback()
+{
+    // Only the newest program change and the newest value of each parameter
+    // are passed on, so a sweep of the volume fader doesn't flood the host
+    // with parameter changes.
+    hostNotifications.drain([this](const HostNotification& notification) {
+        if (notification.type == HostNotification::Type::programChange) {
+            int index = int(notification.value);
+            setPresetParameters(index);
+            syncedProgram.store(index, std::memory_order_release);
+            updateHostDisplay(juce::AudioProcessorListener::ChangeDetails().withProgramChanged(true));
+        } else {
+            auto* param = params[notification.parameter];
+            param->beginChangeGesture();
+            param->setValueNotifyingHost(notification.value);
+            param->endChangeGesture();
         }
+    });
+
+    // The audio thread found a controller to learn.
+    int controller = learnedController.exchange(-1, std::memory_order_acquire);
+    if (controller >= 0 && learnParameter >= 0) {
+        midiLearn.map(controller, learnParameter, learnHighResolution);
+        learnParameter = -1;
     }
 
-    // Render the audio after the last MIDI event. If there were no
-    // MIDI events at all, this renders the entire buffer.
-    int samplesLastSegment = buffer.getNumSamples() - bufferOffset;
-    if (samplesLastSegment > 0) {
-        render(buffer, samplesLastSegment, bufferOffset);
+    // setLatencySamples tells the host with updateHostDisplay. Most hosts
+    // only apply the new delay compensation when playback starts again.
+    int latency = synthLatency.load(std::memory_order_relaxed);
+    if (latency != getLatencySamples()) {
+        setLatencySamples(latency);
     }
 
-    midiMessages.clear();
+    // The Worker Threads parameter changed. The threads can't be started
+    // while the audio thread is rendering, so pause the processing. That
+    // makes the plug-in skip a block or so, which is why this is not
+    // automatable.
+    int numWorkerThreads = chooseNumWorkerThreads();
+    if (prepared && numWorkerThreads != synth.numWorkerThreads) {
+        suspendProcessing(true);
+        synth.numWorkerThreads = numWorkerThreads;
+        synth.startWorkerThreads();
+        suspendProcessing(false);
+    }
 }
 
-void JX11AudioProcessor::handleMIDI(uint8_t data0, uint8_t data1, uint8_t data2)
+int JX11AudioProcessor::chooseNumWorkerThreads() const
 {
-    // Print out the MIDI message:
-    //char s[16];
-    //snprintf(s, 16, "%02hhX %02hhX %02hhX", data0, data1, data2);
-    //DBG(s);
+    // Leave at least one CPU core for the host's own threads.
+    int maxThreads = juce::SystemStats::getNumPhysicalCpus() - 2;
+    return juce::jlimit(0, juce::jmax(0, maxThreads), workerThreadsParam->getIndex());
+}
 
-    // Control Change
-    if ((data0 & 0xF0) == 0xB0) {
-        if (data1 == 0x07) {  // volume
-            float volumeCtl = float(data2) / 127.0f;
-            outputLevelParam->beginChangeGesture();
-            outputLevelParam->setValueNotifyingHost(volumeCtl);
-            outputLevelParam->endChangeGesture();
-        }
+void JX11AudioProcessor::startMidiLearn(int parameter, bool highResolution)
+{
+    if (parameter < 0 || parameter >= NUM_PARAMS) { return; }
+
+    learnParameter = parameter;
+    learnHighResolution = highResolution;
+    learnedController.store(-1, std::memory_order_relaxed);
+    midiLearnArmed.store(true, std::memory_order_release);
+}
+
+void JX11AudioProcessor::cancelMidiLearn()
+{
+    midiLearnArmed.store(false, std::memory_order_relaxed);
+    learnParameter = -1;
+}
+
+juce::StringArray JX11AudioProcessor::getParameterNames() const
+{
+    juce::StringArray names;
+    for (int i = 0; i < NUM_PARAMS; ++i) {
+        names.add(params[i]->getName(32));
     }
+    return names;
+}
 
-    // Program Change
-    if ((data0 & 0xF0) == 0xC0) {
-        if (data1 < presets.size()) {
-            setCurrentProgram(data1);
+juce::String JX11AudioProcessor::getMidiLearnSummary() const
+{
+    juce::StringArray mappings;
+    for (int controller = 0; controller < MidiLearnTable::NUM_CONTROLLERS; ++controller) {
+        int parameter = midiLearn.getParameter(controller);
+        if (parameter < 0 || midiLearn.isLowerHalf(controller)) { continue; }
+
+        juce::String text = "CC " + juce::String(controller);
+        if (midiLearn.isHighResolution(controller)) {
+            text += "/" + juce::String(controller + MidiLearnTable::NUM_PAIRS);
         }
+        mappings.add(text + " " + params[parameter]->getName(32));
     }
-
-    synth.midiMessage(data0, data1, data2);
+    return mappings.isEmpty() ? juce::String("No controllers learned") : mappings.joinIntoString(", ");
 }
 
 void JX11AudioProcessor::render(juce::AudioBuffer<float>& buffer, int sampleCount, int bufferOffset)
@@ -434,7 +696,12 @@ void JX11AudioProcessor::render(juce::AudioBuffer<float>& buffer, int sampleCoun
         outputBuffers[1] = buffer.getWritePointer(1) + bufferOffset;
     }
 
+    blockSegments += 1;
+    blockPeakVoices = std::max(blockPeakVoices, synth.getNumActiveVoices());
+
+    const int64_t startTicks = juce::Time::getHighResolutionTicks();
     synth.render(outputBuffers, sampleCount);
+    renderTicks += juce::Time::getHighResolutionTicks() - startTicks;
 }
 
 //==============================================================================
@@ -445,9 +712,24 @@ bool JX11AudioProcessor::hasEditor() const
 
 juce::AudioProcessorEditor* JX11AudioProcessor::createEditor()
 {
-    auto editor = new juce::GenericAudioProcessorEditor(*this);
-    editor->setSize(500, 1050);
-    return editor;
+    return new JX11AudioProcessorEditor(*this);
+}
+
+bool JX11AudioProcessor::saveLoadReport(const juce::File& file) const
+{
+    juce::StringArray presetNames;
+    for (const auto& preset : presets) {
+        presetNames.add(preset.name);
+    }
+
+    juce::FileOutputStream stream(file);
+    if (!stream.openedOk()) {
+        return false;
+    }
+    stream.setPosition(0);
+    stream.truncate();
+    loadMeter.writeReport(stream, presetNames);
+    return stream.getStatus().wasOk();
 }
 
 //==============================================================================
@@ -455,76 +737,27 @@ void JX11AudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
     //DBG(apvts.copyState().toXmlString());
 
-    copyXmlToBinary(*apvts.copyState().createXml(), destData);
+    // The MIDI learn mappings are not parameters, so they get an element of
+    // their own.
+    std::unique_ptr<juce::XmlElement> xml(apvts.copyState().createXml());
+    xml->addChildElement(midiLearn.createXml().release());
+    copyXmlToBinary(*xml, destData);
 }
 
 void JX11AudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
     std::unique_ptr<juce::XmlElement> xml(getXmlFromBinary(data, sizeInBytes));
     if (xml.get() != nullptr && xml->hasTagName(apvts.state.getType())) {
+        if (auto* mappings = xml->getChildByName(MidiLearnTable::XML_TAG)) {
+            midiLearn.loadXml(*mappings);
+            xml->removeChildElement(mappings, true);
+        } else {
+            midiLearn.clear();
+        }
         apvts.replaceState(juce::ValueTree::fromXml(*xml));
-        parametersChanged.store(true);
     }
 }
 
-//==============================================================================
-void JX11AudioProcessor::createPrograms()
-{
-    presets.emplace_back("Init", 0.00f, -12.00f, 0.00f, 0.00f, 35.00f, 0.00f, 100.00f, 15.00f, 50.00f, 0.00f, 0.00f, 0.00f, 30.00f, 0.00f, 25.00f, 0.00f, 50.00f, 100.00f, 30.00f, 0.81f, 0.00f, 0.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("5th Sweep Pad", 100.00f, -7.00f, -6.30f, 1.00f, 32.00f, 0.00f, 90.00f, 60.00f, -76.00f, 0.00f, 0.00f, 90.00f, 89.00f, 90.00f, 73.00f, 0.00f, 50.00f, 100.00f, 71.00f, 0.81f, 30.00f, 0.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Echo Pad [SA]", 88.00f, 0.00f, 0.00f, 0.00f, 49.00f, 0.00f, 46.00f, 76.00f, 38.00f, 10.00f, 38.00f, 100.00f, 86.00f, 76.00f, 57.00f, 30.00f, 80.00f, 68.00f, 66.00f, 0.79f, -74.00f, 25.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Space Chimes [SA]", 88.00f, 0.00f, 0.00f, 0.00f, 49.00f, 0.00f, 49.00f, 82.00f, 32.00f, 8.00f, 78.00f, 85.00f, 69.00f, 76.00f, 47.00f, 12.00f, 22.00f, 55.00f, 66.00f, 0.89f, -32.00f, 0.00f, 2.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Solid Backing", 100.00f, -12.00f, -18.70f, 0.00f, 35.00f, 0.00f, 30.00f, 25.00f, 40.00f, 0.00f, 26.00f, 0.00f, 35.00f, 0.00f, 25.00f, 0.00f, 50.00f, 100.00f, 30.00f, 0.81f, 0.00f, 50.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Velocity Backing [SA]", 41.00f, 0.00f, 9.70f, 0.00f, 8.00f, -1.68f, 49.00f, 1.00f, -32.00f, 0.00f, 86.00f, 61.00f, 87.00f, 100.00f, 93.00f, 11.00f, 48.00f, 98.00f, 32.00f, 0.81f, 0.00f, 0.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Rubber Backing [ZF]", 29.00f, 12.00f, -5.60f, 0.00f, 18.00f, 5.06f, 35.00f, 15.00f, 54.00f, 14.00f, 8.00f, 0.00f, 42.00f, 13.00f, 21.00f, 0.00f, 56.00f, 0.00f, 32.00f, 0.20f, 16.00f, 22.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("808 State Lead", 100.00f, 7.00f, -7.10f, 2.00f, 34.00f, 12.35f, 65.00f, 63.00f, 50.00f, 16.00f, 0.00f, 0.00f, 30.00f, 0.00f, 25.00f, 17.00f, 50.00f, 100.00f, 3.00f, 0.81f, 0.00f, 0.00f, 1.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Mono Glide", 0.00f, -12.00f, 0.00f, 2.00f, 46.00f, 0.00f, 51.00f, 0.00f, 0.00f, 0.00f, -100.00f, 0.00f, 30.00f, 0.00f, 25.00f, 37.00f, 50.00f, 100.00f, 38.00f, 0.81f, 24.00f, 0.00f, 0.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Detuned Techno Lead", 84.00f, 0.00f, -17.20f, 2.00f, 41.00f, -0.15f, 54.00f, 1.00f, 16.00f, 21.00f, 34.00f, 0.00f, 9.00f, 100.00f, 25.00f, 20.00f, 85.00f, 100.00f, 30.00f, 0.83f, -82.00f, 40.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Hard Lead [SA]", 71.00f, 12.00f, 0.00f, 0.00f, 24.00f, 36.00f, 56.00f, 52.00f, 38.00f, 19.00f, 40.00f, 100.00f, 14.00f, 65.00f, 95.00f, 7.00f, 91.00f, 100.00f, 15.00f, 0.84f, -34.00f, 0.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Bubble", 0.00f, -12.00f, -0.20f, 0.00f, 71.00f, -0.00f, 23.00f, 77.00f, 60.00f, 32.00f, 26.00f, 40.00f, 18.00f, 66.00f, 14.00f, 0.00f, 38.00f, 65.00f, 16.00f, 0.48f, 0.00f, 0.00f, 1.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Monosynth", 62.00f, -12.00f, 0.00f, 1.00f, 35.00f, 0.02f, 64.00f, 39.00f, 2.00f, 65.00f, -100.00f, 7.00f, 52.00f, 24.00f, 84.00f, 13.00f, 30.00f, 76.00f, 21.00f, 0.58f, -40.00f, 0.00f, -1.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Moogcury Lite", 81.00f, 24.00f, -9.80f, 1.00f, 15.00f, -0.97f, 39.00f, 17.00f, 38.00f, 40.00f, 24.00f, 0.00f, 47.00f, 19.00f, 37.00f, 0.00f, 50.00f, 20.00f, 33.00f, 0.38f, 6.00f, 0.00f, -2.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Gangsta Whine", 0.00f, 0.00f, 0.00f, 2.00f, 44.00f, 0.00f, 41.00f, 46.00f, 0.00f, 0.00f, -100.00f, 0.00f, 0.00f, 100.00f, 25.00f, 15.00f, 50.00f, 100.00f, 32.00f, 0.81f, -2.00f, 0.00f, 2.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Higher Synth [ZF]", 48.00f, 0.00f, -8.80f, 0.00f, 0.00f, 0.00f, 50.00f, 47.00f, 46.00f, 30.00f, 60.00f, 0.00f, 10.00f, 0.00f, 7.00f, 0.00f, 42.00f, 0.00f, 22.00f, 0.21f, 18.00f, 16.00f, 2.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("303 Saw Bass", 0.00f, 0.00f, 0.00f, 1.00f, 49.00f, 0.00f, 55.00f, 75.00f, 38.00f, 35.00f, 0.00f, 0.00f, 56.00f, 0.00f, 56.00f, 0.00f, 80.00f, 100.00f, 24.00f, 0.26f, -2.00f, 0.00f, -2.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("303 Square Bass", 75.00f, 0.00f, 0.00f, 1.00f, 49.00f, 0.00f, 55.00f, 75.00f, 38.00f, 35.00f, 0.00f, 14.00f, 49.00f, 0.00f, 39.00f, 0.00f, 80.00f, 100.00f, 24.00f, 0.26f, -2.00f, 0.00f, -2.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Analog Bass", 100.00f, -12.00f, -10.90f, 1.00f, 19.00f, 0.00f, 30.00f, 51.00f, 70.00f, 9.00f, -100.00f, 0.00f, 88.00f, 0.00f, 21.00f, 0.00f, 50.00f, 100.00f, 46.00f, 0.81f, 0.00f, 0.00f, -1.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Analog Bass 2", 100.00f, -12.00f, -10.90f, 0.00f, 19.00f, 13.44f, 48.00f, 43.00f, 88.00f, 0.00f, 60.00f, 0.00f, 0.00f, 0.00f, 0.00f, 0.00f, 61.00f, 100.00f, 32.00f, 0.81f, 0.00f, 0.00f, -1.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Low Pulses", 97.00f, -12.00f, -3.30f, 0.00f, 35.00f, 0.00f, 80.00f, 40.00f, 4.00f, 0.00f, 0.00f, 0.00f, 77.00f, 0.00f, 25.00f, 0.00f, 50.00f, 100.00f, 30.00f, 0.81f, -68.00f, 0.00f, -2.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Sine Infra-Bass", 0.00f, -12.00f, 0.00f, 0.00f, 35.00f, 0.00f, 33.00f, 76.00f, 6.00f, 0.00f, 0.00f, 0.00f, 30.00f, 0.00f, 25.00f, 0.00f, 55.00f, 25.00f, 30.00f, 0.81f, 4.00f, 0.00f, -2.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Wobble Bass [SA]", 100.00f, -12.00f, -8.80f, 0.00f, 82.00f, 0.21f, 72.00f, 47.00f, -32.00f, 34.00f, 64.00f, 20.00f, 69.00f, 100.00f, 15.00f, 9.00f, 50.00f, 100.00f, 7.00f, 0.81f, -8.00f, 0.00f, -1.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Squelch Bass", 100.00f, -12.00f, -8.80f, 0.00f, 35.00f, 0.00f, 67.00f, 70.00f, -48.00f, 0.00f, 0.00f, 48.00f, 69.00f, 100.00f, 15.00f, 0.00f, 50.00f, 100.00f, 7.00f, 0.81f, -8.00f, 0.00f, -1.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Rubber Bass [ZF]", 49.00f, -12.00f, 1.60f, 1.00f, 35.00f, 0.00f, 36.00f, 15.00f, 50.00f, 20.00f, 0.00f, 0.00f, 38.00f, 0.00f, 25.00f, 0.00f, 60.00f, 100.00f, 22.00f, 0.19f, 0.00f, 0.00f, -2.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Soft Pick Bass", 37.00f, 0.00f, 7.80f, 0.00f, 22.00f, 0.00f, 33.00f, 47.00f, 42.00f, 16.00f, 18.00f, 0.00f, 0.00f, 0.00f, 25.00f, 4.00f, 58.00f, 0.00f, 22.00f, 0.15f, -12.00f, 33.00f, -2.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Fretless Bass", 50.00f, 0.00f, -14.40f, 1.00f, 34.00f, 0.00f, 51.00f, 0.00f, 16.00f, 0.00f, 34.00f, 0.00f, 9.00f, 0.00f, 25.00f, 20.00f, 85.00f, 0.00f, 30.00f, 0.81f, 40.00f, 0.00f, -2.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Whistler", 23.00f, 0.00f, -0.70f, 0.00f, 35.00f, 0.00f, 33.00f, 100.00f, 0.00f, 0.00f, 0.00f, 0.00f, 29.00f, 0.00f, 25.00f, 68.00f, 39.00f, 58.00f, 36.00f, 0.81f, 28.00f, 38.00f, 2.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Very Soft Pad", 39.00f, 0.00f, -4.90f, 2.00f, 12.00f, 0.00f, 35.00f, 78.00f, 0.00f, 0.00f, 0.00f, 0.00f, 30.00f, 0.00f, 25.00f, 35.00f, 50.00f, 80.00f, 70.00f, 0.81f, 0.00f, 0.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Pizzicato", 0.00f, -12.00f, 0.00f, 0.00f, 35.00f, 0.00f, 23.00f, 20.00f, 50.00f, 0.00f, 0.00f, 0.00f, 22.00f, 0.00f, 25.00f, 0.00f, 47.00f, 0.00f, 30.00f, 0.81f, 0.00f, 80.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Synth Strings", 100.00f, 0.00f, -7.10f, 0.00f, 0.00f, -0.97f, 42.00f, 26.00f, 50.00f, 14.00f, 38.00f, 0.00f, 67.00f, 55.00f, 97.00f, 82.00f, 70.00f, 100.00f, 42.00f, 0.84f, 34.00f, 30.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Synth Strings 2", 75.00f, 0.00f, -3.80f, 0.00f, 49.00f, 0.00f, 55.00f, 16.00f, 38.00f, 8.00f, -60.00f, 76.00f, 29.00f, 76.00f, 100.00f, 46.00f, 80.00f, 100.00f, 39.00f, 0.79f, -46.00f, 0.00f, 1.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Leslie Organ", 0.00f, 0.00f, 0.00f, 0.00f, 13.00f, -0.38f, 38.00f, 74.00f, 8.00f, 20.00f, -100.00f, 0.00f, 55.00f, 52.00f, 31.00f, 0.00f, 17.00f, 73.00f, 28.00f, 0.87f, -52.00f, 0.00f, -1.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Click Organ", 50.00f, 12.00f, 0.00f, 0.00f, 35.00f, 0.00f, 44.00f, 50.00f, 30.00f, 16.00f, -100.00f, 0.00f, 0.00f, 18.00f, 0.00f, 0.00f, 75.00f, 80.00f, 0.00f, 0.81f, -2.00f, 0.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Hard Organ", 89.00f, 19.00f, -0.90f, 0.00f, 35.00f, 0.00f, 51.00f, 62.00f, 8.00f, 0.00f, -100.00f, 0.00f, 37.00f, 0.00f, 100.00f, 4.00f, 8.00f, 72.00f, 4.00f, 0.77f, -2.00f, 0.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Bass Clarinet", 100.00f, 0.00f, 0.00f, 1.00f, 0.00f, 0.00f, 51.00f, 10.00f, 0.00f, 11.00f, 0.00f, 0.00f, 0.00f, 0.00f, 25.00f, 35.00f, 65.00f, 65.00f, 32.00f, 0.79f, -2.00f, 20.00f, -1.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Trumpet", 0.00f, 0.00f, 0.00f, 1.00f, 6.00f, 0.00f, 57.00f, 0.00f, -36.00f, 15.00f, 0.00f, 21.00f, 15.00f, 0.00f, 25.00f, 24.00f, 60.00f, 80.00f, 10.00f, 0.75f, 10.00f, 25.00f, 1.00f, 0.00f, 0.00f, 0.00f);
-    presets.emplace_back("Soft Horn", 12.00f, 19.00f, 1.90f, 0.00f, 35.00f, 0.00f, 50.00f, 21.00f, -42.00f, 12.00f, 20.00f, 0.00f, 35.00f, 36.00f, 25.00f, 8.00f, 50.00f, 100.00f, 27.00f, 0.83f, 2.00f, 10.00f, -1.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Brass Section", 43.00f, 12.00f, -7.90f, 0.00f, 28.00f, -0.79f, 50.00f, 0.00f, 18.00f, 0.00f, 0.00f, 24.00f, 16.00f, 91.00f, 8.00f, 17.00f, 50.00f, 80.00f, 45.00f, 0.81f, 0.00f, 0.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Synth Brass", 40.00f, 0.00f, -6.30f, 0.00f, 30.00f, -3.07f, 39.00f, 15.00f, 50.00f, 0.00f, 0.00f, 39.00f, 30.00f, 82.00f, 25.00f, 33.00f, 74.00f, 76.00f, 41.00f, 0.81f, -6.00f, 23.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Detuned Syn Brass [ZF]", 68.00f, 0.00f, 31.80f, 0.00f, 31.00f, 0.50f, 26.00f, 7.00f, 70.00f, 0.00f, 32.00f, 0.00f, 83.00f, 0.00f, 5.00f, 0.00f, 75.00f, 54.00f, 32.00f, 0.76f, -26.00f, 29.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Power PWM", 100.00f, -12.00f, -8.80f, 0.00f, 35.00f, 0.00f, 82.00f, 13.00f, 50.00f, 0.00f, -100.00f, 24.00f, 30.00f, 88.00f, 34.00f, 0.00f, 50.00f, 100.00f, 48.00f, 0.71f, -26.00f, 0.00f, -1.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Water Velocity [SA]", 76.00f, 0.00f, -1.40f, 0.00f, 49.00f, 0.00f, 87.00f, 67.00f, 100.00f, 32.00f, -82.00f, 95.00f, 56.00f, 72.00f, 100.00f, 4.00f, 76.00f, 11.00f, 46.00f, 0.88f, 44.00f, 0.00f, -1.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Ghost [SA]", 75.00f, 0.00f, -7.10f, 2.00f, 16.00f, -0.00f, 38.00f, 58.00f, 50.00f, 16.00f, 62.00f, 0.00f, 30.00f, 40.00f, 31.00f, 37.00f, 50.00f, 100.00f, 54.00f, 0.85f, 66.00f, 43.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Soft E.Piano", 31.00f, 0.00f, -0.20f, 0.00f, 35.00f, 0.00f, 34.00f, 26.00f, 6.00f, 0.00f, 26.00f, 0.00f, 22.00f, 0.00f, 39.00f, 0.00f, 80.00f, 0.00f, 44.00f, 0.81f, 2.00f, 0.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Thumb Piano", 72.00f, 15.00f, 50.00f, 0.00f, 35.00f, 0.00f, 37.00f, 47.00f, 8.00f, 0.00f, 0.00f, 0.00f, 45.00f, 0.00f, 39.00f, 0.00f, 39.00f, 0.00f, 48.00f, 0.81f, 20.00f, 0.00f, 1.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Steel Drums [ZF]", 81.00f, 12.00f, -12.00f, 0.00f, 18.00f, 2.30f, 40.00f, 30.00f, 8.00f, 17.00f, -20.00f, 0.00f, 42.00f, 23.00f, 47.00f, 12.00f, 48.00f, 0.00f, 49.00f, 0.53f, -28.00f, 34.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Car Horn", 57.00f, -1.00f, -2.80f, 0.00f, 35.00f, 0.00f, 46.00f, 0.00f, 36.00f, 0.00f, 0.00f, 46.00f, 30.00f, 100.00f, 23.00f, 30.00f, 50.00f, 100.00f, 31.00f, 1.00f, -24.00f, 0.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Helicopter", 0.00f, -12.00f, 0.00f, 0.00f, 35.00f, 0.00f, 8.00f, 36.00f, 38.00f, 100.00f, 0.00f, 100.00f, 100.00f, 0.00f, 100.00f, 96.00f, 50.00f, 100.00f, 92.00f, 0.97f, 0.00f, 100.00f, -2.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Arctic Wind", 0.00f, -12.00f, 0.00f, 0.00f, 35.00f, 0.00f, 16.00f, 85.00f, 0.00f, 28.00f, 0.00f, 37.00f, 30.00f, 0.00f, 25.00f, 89.00f, 50.00f, 100.00f, 89.00f, 0.24f, 0.00f, 100.00f, 2.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Thip", 100.00f, -7.00f, 0.00f, 0.00f, 35.00f, 0.00f, 0.00f, 100.00f, 94.00f, 0.00f, 0.00f, 2.00f, 20.00f, 0.00f, 20.00f, 0.00f, 46.00f, 0.00f, 30.00f, 0.81f, 0.00f, 78.00f, 0.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Synth Tom", 0.00f, -12.00f, 0.00f, 0.00f, 76.00f, 24.53f, 30.00f, 33.00f, 52.00f, 0.00f, 36.00f, 0.00f, 59.00f, 0.00f, 59.00f, 10.00f, 50.00f, 0.00f, 50.00f, 0.81f, 0.00f, 70.00f, -2.00f, 0.00f, 0.00f, 1.00f);
-    presets.emplace_back("Squelchy Frog", 50.00f, -5.00f, -7.90f, 2.00f, 77.00f, -36.00f, 40.00f, 65.00f, 90.00f, 0.00f, 0.00f, 33.00f, 50.00f, 0.00f, 25.00f, 0.00f, 70.00f, 65.00f, 18.00f, 0.32f, 100.00f, 0.00f, -2.00f, 0.00f, 0.00f, 1.00f);
-}
-
 juce::AudioProcessorValueTreeState::ParameterLayout JX11AudioProcessor::createParameterLayout()
 {
     juce::AudioProcessorValueTreeState::ParameterLayout layout;
@@ -532,9 +765,48 @@ juce::AudioProcessorValueTreeState::ParameterLayout JX11AudioProcessor::createPa
     layout.add(std::make_unique<juce::AudioParameterChoice>(
         ParameterID::polyMode,
         "Polyphony",
-        juce::StringArray { "Mono", "Poly" },
+        juce::StringArray { "Mono", "Poly", "Poly 16", "Poly 32", "Poly 64", "Poly 128" },
+        1));
+
+    // What happens to the notes that are playing when the program changes:
+    // Reset stops them, Smooth lets them continue with the new preset. Not
+    // part of the presets.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        ParameterID::programChange,
+        "Program Change",
+        juce::StringArray { "Reset", "Smooth" },
         1));
 
+    // How late the mod wheel, aftertouch, pitch bend and other continuous
+    // controllers may be, so that they can be handled together. Notes are
+    // always on time. Not part of the presets.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        ParameterID::midiTiming,
+        "MIDI Timing",
+        juce::StringArray { "Exact", "1 ms", "3 ms", "10 ms" },
+        2));
+
+    // How many real-time threads help the audio thread render the voices.
+    // This only pays off with many voices playing at once, and every
+    // instance of the plug-in gets its own threads, so the default is Off.
+    // The audio thread wakes them up and waits for them without locks, see
+    // VoiceThreadPool, but if the system gives their cores to other threads
+    // the audio thread still has to wait. Not part of the presets.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        ParameterID::workerThreads,
+        "Worker Threads",
+        juce::StringArray { "Off", "1", "2", "3" },
+        0,
+        juce::AudioParameterChoiceAttributes().withAutomatable(false)));
+
+    // Which voice to take for a new note in poly mode when all of them are
+    // playing. Not part of the presets.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        ParameterID::voiceStealing,
+        "Voice Stealing",
+        juce::StringArray { "Quietest", "Oldest", "Same Note", "Keep Lowest", "Keep Highest" },
+        0));
+
     layout.add(std::make_unique<juce::AudioParameterFloat>(
         ParameterID::oscTune,
         "Osc Tune",
@@ -565,6 +837,31 @@ juce::AudioProcessorValueTreeState::ParameterLayout JX11AudioProcessor::createPa
                 .withLabel("%")
                 .withStringFromValueFunction(oscMixStringFromValue)));
 
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        ParameterID::oscEngine,
+        "Osc Engine",
+        juce::StringArray { "BLIT", "PolyBLEP" },
+        0));
+
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        ParameterID::oversampling,
+        "Oversampling",
+        juce::StringArray { "Off", "2x", "4x" },
+        0));
+
+    // Auto picks Lean when playing live and High when the host renders
+    // offline. Lean uses the Control Rate, Osc Engine and Oversampling
+    // parameters as they are. High ignores the Control Rate and Oversampling
+    // parameters, which the editor shows below the parameters. Its 4x
+    // oversampling changes the latency, see Decimator::getLatency, and the
+    // host is told about this. A bounce with Auto doesn't exactly match what
+    // was heard while mixing, so pick Lean for that.
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        ParameterID::quality,
+        "Quality",
+        juce::StringArray { "Auto", "Lean", "High" },
+        0));
+
     layout.add(std::make_unique<juce::AudioParameterChoice>(
         ParameterID::glideMode,
         "Glide Mode",
@@ -701,6 +998,13 @@ juce::AudioProcessorValueTreeState::ParameterLayout JX11AudioProcessor::createPa
                 .withLabel("Hz")
                 .withStringFromValueFunction(lfoRateStringFromValue)));
 
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        ParameterID::controlRate,
+        "Control Rate",
+        juce::StringArray { "8 samples", "16 samples", "32 samples", "64 samples",
+                            "1 kHz", "2 kHz", "4 kHz" },
+        2));
+
     auto vibratoStringFromValue = [](float value, int)
     {
         if (value < 0.0f)
@@ -11,46 +11,16 @@
 #include <JuceHeader.h>
 #include "Synth.h"
 #include "Preset.h"
-
-namespace ParameterID
-{
-    #define PARAMETER_ID(str) const juce::ParameterID str(#str, 1);
-
-    PARAMETER_ID(oscMix)
-    PARAMETER_ID(oscTune)
-    PARAMETER_ID(oscFine)
-    PARAMETER_ID(glideMode)
-    PARAMETER_ID(glideRate)
-    PARAMETER_ID(glideBend)
-    PARAMETER_ID(filterFreq)
-    PARAMETER_ID(filterReso)
-    PARAMETER_ID(filterEnv)
-    PARAMETER_ID(filterLFO)
-    PARAMETER_ID(filterVelocity)
-    PARAMETER_ID(filterAttack)
-    PARAMETER_ID(filterDecay)
-    PARAMETER_ID(filterSustain)
-    PARAMETER_ID(filterRelease)
-    PARAMETER_ID(envAttack)
-    PARAMETER_ID(envDecay)
-    PARAMETER_ID(envSustain)
-    PARAMETER_ID(envRelease)
-    PARAMETER_ID(lfoRate)
-    PARAMETER_ID(vibrato)
-    PARAMETER_ID(noise)
-    PARAMETER_ID(octave)
-    PARAMETER_ID(tuning)
-    PARAMETER_ID(outputLevel)
-    PARAMETER_ID(polyMode)
-
-    #undef PARAMETER_ID
-}
+#include "ParameterMapping.h"
+#include "LoadMeter.h"
+#include "EventScheduler.h"
+#include "HostNotifications.h"
+#include "MidiLearn.h"
 
 //==============================================================================
 /**
 */
-class JX11AudioProcessor  : public juce::AudioProcessor,
-                            private juce::ValueTree::Listener
+class JX11AudioProcessor  : public juce::AudioProcessor, private juce::Timer
 {
 public:
     //==============================================================================
@@ -93,31 +63,162 @@ public:
 
     juce::AudioProcessorValueTreeState apvts { *this, nullptr, "Parameters", createParameterLayout() };
 
+    // For the editor. These are safe to use from the message thread.
+    LoadMeter& getLoadMeter() { return loadMeter; }
+    const TelemetryTotals& getTelemetryTotals() const { return telemetryLogger.totals; }
+
+    // Writes the load meter's report as CSV. Returns false if the file
+    // could not be written.
+    bool saveLoadReport(const juce::File& file) const;
+
+    // MIDI learn, for the editor. Call these from the message thread.
+    // startMidiLearn maps the next controller that moves to the parameter,
+    // which is a ParamIndex.
+    void startMidiLearn(int parameter, bool highResolution);
+    void cancelMidiLearn();
+    bool isMidiLearning() const { return learnParameter >= 0; }
+    void forgetMidiLearn(int parameter) { midiLearn.forgetParameter(parameter); }
+
+    // The names of the preset parameters, in the order of ParamIndex.
+    juce::StringArray getParameterNames() const;
+
+    // One line of text with the controllers and their parameters.
+    juce::String getMidiLearnSummary() const;
+
+    // One line of text with the quality profile that the Quality parameter
+    // asks for, and which parameters it overrides.
+    juce::String getQualitySummary() const;
+
 private:
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
-    void valueTreePropertyChanged(juce::ValueTree&, const juce::Identifier&) override
-    {
-        parametersChanged.store(true);
-    }
+    // Reads the current parameter values and returns which ones are different
+    // from the last time this was called, one bit per ParamIndex.
+    uint32_t changedParameters();
+
+    // Recalculates the synth settings that depend on the changed parameters.
+    void update(uint32_t changed);
 
-    std::atomic<bool> parametersChanged { false };
+    // Reads the preset parameters into `values`, in the units of Preset::param.
+    void readParameterValues(float* values) const;
 
-    void update();
-    void createPrograms();
+    // Calculates the synth settings for every factory preset, so that a
+    // program change doesn't have to. Don't call this from the audio thread.
+    void prepareProgramSettings();
 
-    void splitBufferByEvents(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
-    void handleMIDI(uint8_t data0, uint8_t data1, uint8_t data2);
+    // Makes the synth use the preset. This doesn't touch the parameters.
+    // Call this from the audio thread.
+    void changeProgram(int index);
+
+    // Puts the preset's values into the parameters and tells the host.
+    void setPresetParameters(int index);
+
+    // Makes changedParameters treat the values that setPresetParameters put
+    // into the parameters as old news, because the synth already has them.
+    void rememberPresetValues(int index);
+
+    // Changes the synth's settings for the parameters in `changed`, without
+    // touching the parameters. `normalized` holds their new values, from 0
+    // to 1, in the order of ParamIndex.
+    void changeParameters(const float* normalized, uint32_t changed);
+
+    // The quality profile that the Quality parameter asks for. For Auto this
+    // depends on whether the host is rendering offline.
+    const QualityProfile* chooseQualityProfile() const;
+
+    void splitBufferByEvents(juce::AudioBuffer<float>& buffer);
+    void handleHostEvents();
     void render(juce::AudioBuffer<float>& buffer, int sampleCount, int bufferOffset);
 
+    // Tells the host about the changes in hostNotifications, and about a new
+    // latency. Also starts or stops worker threads.
+    void timerCallback() override;
+
+    // The number of worker threads for the Worker Threads parameter.
+    int chooseNumWorkerThreads() const;
+
+    // For the telemetry: how many times processBlock called render, and the
+    // most voices that were playing at the start of those calls.
+    int blockSegments;
+    int blockPeakVoices;
+
+    // For the load meter: how long the calls to Synth::render took in this
+    // block, in high resolution ticks.
+    int64_t renderTicks;
+
     // The factory presets.
     std::vector<Preset> presets;
 
-    // Index of the active preset.
-    int currentProgram;
+    // Index of the active preset. A program change over MIDI sets this on
+    // the audio thread.
+    std::atomic<int> currentProgram { 0 };
+
+    // The program that setCurrentProgram chose but the audio thread hasn't
+    // switched to yet, or -1. setCurrentProgram may run on any thread.
+    std::atomic<int> pendingProgram { -1 };
+
+    // The program whose values the message thread has put into the
+    // parameters after a program change over MIDI, or -1.
+    std::atomic<int> syncedProgram { -1 };
+
+    // The last program change over MIDI that the synth has made but the
+    // parameters don't have yet, or -1. Only used on the audio thread.
+    int midiProgram = -1;
+
+    // The MIDI program changes and parameter changes that the synth has
+    // already made, on their way to the message thread, which updates the
+    // parameters.
+    HostNotificationQueue hostNotifications;
+
+    // The synth's latency at the end of the last block. The host can only be
+    // told about a new latency from the message thread.
+    std::atomic<int> synthLatency { 0 };
+
+    // Whether prepareToPlay was called without releaseResources after it.
+    // The worker threads only run while this is true.
+    bool prepared = false;
+
+    // The controllers that change parameters.
+    MidiLearnTable midiLearn;
+
+    // While this is true, the audio thread sends the next controller that
+    // can be learned to the message thread, in learnedController.
+    std::atomic<bool> midiLearnArmed { false };
+    std::atomic<int> learnedController { -1 };
+
+    // What the learned controller gets mapped to. Only used on the message
+    // thread.
+    int learnParameter = -1;
+    bool learnHighResolution = false;
+
+    // The synth settings for each factory preset, calculated with each of the
+    // quality profiles.
+    struct ProgramSettings
+    {
+        const QualityProfile* profile;
+        std::vector<SynthSettings> presets;
+    };
+    std::array<ProgramSettings, 2> programSettings {{
+        { &QualityProfiles::lean, {} },
+        { &QualityProfiles::high, {} },
+    }};
 
     Synth synth;
 
+    // The MIDI events of the current block. The events that change the
+    // plug-in's parameters are in hostEvents, the rest go to the synth.
+    EventQueue synthEvents;
+    EventQueue hostEvents;
+
+    // Decides where the block gets split up for the MIDI events.
+    EventScheduler scheduler;
+
+    // Empties synth.telemetry on a background thread.
+    TelemetryLogger telemetryLogger { synth.telemetry };
+
+    // How long processBlock takes compared to the duration of the block.
+    LoadMeter loadMeter;
+
     juce::AudioParameterFloat* oscMixParam;
     juce::AudioParameterFloat* oscTuneParam;
     juce::AudioParameterFloat* oscFineParam;
@@ -144,6 +245,25 @@ private:
     juce::AudioParameterFloat* tuningParam;
     juce::AudioParameterFloat* outputLevelParam;
     juce::AudioParameterChoice* polyModeParam;
+    juce::AudioParameterChoice* oscEngineParam;
+    juce::AudioParameterChoice* controlRateParam;
+    juce::AudioParameterChoice* oversamplingParam;
+    juce::AudioParameterChoice* qualityParam;
+    juce::AudioParameterChoice* voiceStealingParam;
+    juce::AudioParameterChoice* midiTimingParam;
+    juce::AudioParameterChoice* programChangeParam;
+    juce::AudioParameterChoice* workerThreadsParam;
+
+    // The same parameters, in the same order as the values in Preset.
+    juce::RangedAudioParameter* params[NUM_PARAMS];
+
+    // Parameter values from the previous audio block, normalized to 0 - 1.
+    float lastParamValues[NUM_PARAMS];
+
+    // The quality profile that is being used, and the Quality parameter's
+    // choice from the previous audio block.
+    const QualityProfile* qualityProfile;
+    int lastQualityChoice;
 
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (JX11AudioProcessor)
@@ -1,8 +1,25 @@
 #pragma once
 
 #include <cstring>
+#include <vector>
 
-const int NUM_PARAMS = 26;
+const int NUM_PARAMS = 29;
+
+// Index of each parameter in Preset::param. The plug-in uses the same order.
+namespace ParamIndex
+{
+    enum
+    {
+        oscMix, oscTune, oscFine, glideMode, glideRate, glideBend,
+        filterFreq, filterReso, filterEnv, filterLFO, filterVelocity,
+        filterAttack, filterDecay, filterSustain, filterRelease,
+        envAttack, envDecay, envSustain, envRelease,
+        lfoRate, vibrato, noise, octave, tuning, outputLevel, polyMode,
+        oscEngine, controlRate, oversampling,
+    };
+}
+
+static_assert(ParamIndex::oversampling == NUM_PARAMS - 1, "ParamIndex is out of sync");
 
 // Describes a factory preset.
 struct Preset
@@ -14,7 +31,8 @@ struct Preset
            float p12, float p13, float p14, float p15,
            float p16, float p17, float p18, float p19,
            float p20, float p21, float p22, float p23,
-           float p24, float p25)
+           float p24, float p25, float p26, float p27,
+           float p28)
     {
         strcpy(this->name, name);
         param[0]  = p0;   // Osc Mix
@@ -43,8 +61,14 @@ struct Preset
         param[23] = p23;  // Tuning
         param[24] = p24;  // Output Level
         param[25] = p25;  // Polyphony
+        param[26] = p26;  // Osc Engine
+        param[27] = p27;  // Control Rate
+        param[28] = p28;  // Oversampling
     }
 
     char name[40];
     float param[NUM_PARAMS];
 };
+
+// Fills in the list of factory presets. Used by the plug-in and the tools.
+void createFactoryPresets(std::vector<Preset>& presets);
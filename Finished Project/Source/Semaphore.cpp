@@ -0,0 +1,59 @@
+#include "Semaphore.h"
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+#elif JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#else
+ #include <semaphore.h>
+ #include <cerrno>
+#endif
+
+Semaphore::Semaphore()
+{
+  #if JUCE_WINDOWS
+    handle = CreateSemaphoreW(nullptr, 0, LONG_MAX, nullptr);
+  #elif JUCE_MAC || JUCE_IOS
+    handle = dispatch_semaphore_create(0);
+  #else
+    auto* semaphore = new sem_t;
+    sem_init(semaphore, 0, 0);
+    handle = semaphore;
+  #endif
+}
+
+Semaphore::~Semaphore()
+{
+  #if JUCE_WINDOWS
+    CloseHandle(handle);
+  #elif JUCE_MAC || JUCE_IOS
+    dispatch_release(static_cast<dispatch_semaphore_t>(handle));
+  #else
+    auto* semaphore = static_cast<sem_t*>(handle);
+    sem_destroy(semaphore);
+    delete semaphore;
+  #endif
+}
+
+void Semaphore::wakeUpOne()
+{
+  #if JUCE_WINDOWS
+    ReleaseSemaphore(handle, 1, nullptr);
+  #elif JUCE_MAC || JUCE_IOS
+    dispatch_semaphore_signal(static_cast<dispatch_semaphore_t>(handle));
+  #else
+    sem_post(static_cast<sem_t*>(handle));
+  #endif
+}
+
+void Semaphore::sleep()
+{
+  #if JUCE_WINDOWS
+    WaitForSingleObject(handle, INFINITE);
+  #elif JUCE_MAC || JUCE_IOS
+    dispatch_semaphore_wait(static_cast<dispatch_semaphore_t>(handle), DISPATCH_TIME_FOREVER);
+  #else
+    // A signal handler can interrupt the wait, then simply wait again.
+    while (sem_wait(static_cast<sem_t*>(handle)) != 0 && errno == EINTR) { }
+  #endif
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+// A counting semaphore that the audio thread can signal without locking.
+//
+// juce::WaitableEvent locks a mutex in signal, so the audio thread could have
+// to wait for a lower-priority thread that holds it. Here the count is an
+// atomic, and only a thread that has to sleep in `wait` makes the count go
+// below zero. `signal` then wakes it up with the operating system's
+// semaphore: a futex on Linux, a dispatch semaphore on the Mac, and a kernel
+// semaphore on Windows. None of these take a lock in user space.
+class Semaphore
+{
+public:
+    Semaphore();
+    ~Semaphore();
+
+    // Adds one to the count, and wakes up a thread that is waiting.
+    void signal()
+    {
+        if (count.fetch_add(1, std::memory_order_acq_rel) < 0) {
+            wakeUpOne();
+        }
+    }
+
+    // Takes one from the count, and sleeps until it is signaled if the
+    // count was zero. Don't call this on the audio thread unless the wait is
+    // sure to be short.
+    void wait()
+    {
+        if (count.fetch_sub(1, std::memory_order_acq_rel) <= 0) {
+            sleep();
+        }
+    }
+
+private:
+    void wakeUpOne();
+    void sleep();
+
+    // Negative when threads are waiting.
+    std::atomic<int> count { 0 };
+
+    // The operating system's semaphore.
+    void* handle = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE(Semaphore)
+};
@@ -1,21 +1,53 @@
 #include "Synth.h"
 #include "Utils.h"
 
-static const float ANALOG = 0.002f;   // oscillator drift
-
 // Special "note number" that says this voice is now kept alive by the sustain
 // pedal being pressed down. As soon as the pedal is released, this voice will
 // fade out.
 static const int SUSTAIN = -1;
 
+static_assert(Synth::MAX_CONTROL_PERIOD <= VoiceBank::MAX_SAMPLES, "VoiceBank is too small");
+static_assert(Synth::MAX_VOICES <= VoiceAllocator::MAX_VOICES, "VoiceAllocator is too small");
+static_assert(SUSTAIN == VoiceAllocator::SUSTAINED, "VoiceAllocator is out of sync");
+
 Synth::Synth()
 {
     sampleRate = 44100.0f;
+    oversampling = 1;
+    internalSampleRate = sampleRate;
+    integratorLeak = 0.997f;
+    maxBlockSize = 0;
+    maxInternalSize = 0;
+    useVoiceBank = true;
+    numWorkerThreads = 0;
+    polyBLEP = false;
+    preciseMath = false;
+    controlPeriod = 32;
+    numActiveVoices = 0;
+    silentSamples = 0;
+    sampleTime = 0;
+    allocator.reset();
 }
 
-void Synth::allocateResources(double sampleRate_, int /*samplesPerBlock*/)
+void Synth::allocateResources(double sampleRate_, int samplesPerBlock)
 {
     sampleRate = static_cast<float>(sampleRate_);
+    maxBlockSize = std::max(samplesPerBlock, 1);
+    maxInternalSize = maxBlockSize * MAX_OVERSAMPLING;
+
+    // Buffers for rendering one segment. There is a control step at least
+    // every MIN_CONTROL_PERIOD samples, plus one for the remainder of the
+    // previous block. These are big enough for any oversampling factor, so
+    // that it can be changed without allocating memory.
+    steps.resize(size_t(maxInternalSize / MIN_CONTROL_PERIOD + 2));
+    noiseBuffer.resize(size_t(maxInternalSize));
+    mixLeft.resize(size_t(maxInternalSize));
+    mixRight.resize(size_t(maxInternalSize));
+    groupBuffers.resize(size_t(MAX_GROUPS * 2 * maxInternalSize));
+    decimatorLeft.prepare(maxBlockSize);
+    decimatorRight.prepare(maxBlockSize);
+
+    startWorkerThreads();
 
     // For using the JUCE LadderFilter:
     //juce::dsp::ProcessSpec spec;
@@ -23,18 +55,83 @@ void Synth::allocateResources(double sampleRate_, int /*samplesPerBlock*/)
     //spec.maximumBlockSize = samplesPerBlock;
     //spec.numChannels = 1;
 
-    for (int v = 0; v < MAX_VOICES; ++v) {
-        voices[v].filter.sampleRate = sampleRate;
+    // The filter coefficients are interpolated over each control period,
+    // using the table to find the cutoff.
+    for (size_t i = 0; i < cutoffTables.size(); ++i) {
+        cutoffTables[i].prepare(sampleRate * float(1 << i));
+    }
+
+    // For using the JUCE LadderFilter:
+    //for (int v = 0; v < MAX_VOICES; ++v) {
+    //    voices[v].filter.setMode(juce::dsp::LadderFilterMode::LPF12);
+    //    voices[v].filter.prepare(spec);
+    //}
+
+    updateInternalSampleRate();
+}
+
+void Synth::startWorkerThreads()
+{
+    // Give every thread its own scratch memory. Index 0 is for the audio
+    // thread.
+    threadPool.start(numWorkerThreads);
+    renderContexts.resize(size_t(numWorkerThreads + 1));
+    for (auto& context : renderContexts) {
+        context.voiceBuffer.resize(size_t(maxInternalSize));
+    }
+}
 
-        // For using the JUCE LadderFilter:
-        //voices[v].filter.setMode(juce::dsp::LadderFilterMode::LPF12);
-        //voices[v].filter.prepare(spec);
+void Synth::setOversampling(int factor)
+{
+    jassert(factor == 1 || factor == 2 || factor == 4);
+    if (factor == oversampling) { return; }
+
+    // The playing voices measure their pitch and envelopes in samples, so
+    // convert these to the new rate.
+    float ratio = float(factor) / float(oversampling);
+    for (int i = 0; i < numActiveVoices; ++i) {
+        voices[activeVoices[i]].changeSampleRate(ratio);
+    }
+
+    oversampling = factor;
+    updateInternalSampleRate();
+
+    // The smoothers that run at the voices' rate need to know how many steps
+    // their ramps take now. This ends any ramps that were in progress.
+    noiseMixSmoother.reset(internalSampleRate, 0.05);
+    oscMixSmoother.reset(internalSampleRate, 0.05);
+    filterKeyTrackingSmoother.reset(internalSampleRate, 0.05);
+    filterQSmoother.reset(internalSampleRate, 0.05);
+
+    // What is left in the filters is from the old rate.
+    decimatorLeft.reset();
+    decimatorRight.reset();
+}
+
+void Synth::updateInternalSampleRate()
+{
+    internalSampleRate = sampleRate * float(oversampling);
+
+    // The same leak per second at every rate.
+    integratorLeak = std::pow(0.997f, 1.0f / float(oversampling));
+
+    // The tables are for 1x, 2x and 4x.
+    const CutoffTable* cutoffTable = &cutoffTables[size_t(oversampling / 2)];
+
+    for (int v = 0; v < MAX_VOICES; ++v) {
+        voices[v].filter.sampleRate = internalSampleRate;
+        voices[v].filter.cutoffTable = cutoffTable;
     }
 }
 
 void Synth::deallocateResources()
 {
-    // do nothing
+    threadPool.stop();
+
+    groupBuffers.clear();
+    groupBuffers.shrink_to_fit();
+    renderContexts.clear();
+    renderContexts.shrink_to_fit();
 }
 
 void Synth::reset()
@@ -43,8 +140,14 @@ void Synth::reset()
     for (int v = 0; v < MAX_VOICES; ++v) {
         voices[v].reset();
     }
+    numActiveVoices = 0;
+    allocator.reset();
+    noteStack.clear();
 
     noiseGen.reset();
+    decimatorLeft.reset();
+    decimatorRight.reset();
+    silentSamples = Decimator::FLUSH_SAMPLES;
 
     // These variables are changed by MIDI CC, reset to defaults.
     pitchBend = 1.0f;
@@ -60,7 +163,13 @@ void Synth::reset()
     lastNote = 0;
     filterZip = 0.0f;
 
+    // The output level is smoothed after the decimator, at the host's rate.
+    // The others are used by the voices.
     outputLevelSmoother.reset(sampleRate, 0.05);
+    noiseMixSmoother.reset(internalSampleRate, 0.05);
+    oscMixSmoother.reset(internalSampleRate, 0.05);
+    filterKeyTrackingSmoother.reset(internalSampleRate, 0.05);
+    filterQSmoother.reset(internalSampleRate, 0.05);
 }
 
 void Synth::render(float** outputBuffers, int sampleCount)
@@ -68,74 +177,312 @@ void Synth::render(float** outputBuffers, int sampleCount)
     float* outputBufferLeft = outputBuffers[0];
     float* outputBufferRight = outputBuffers[1];
 
+    // When nothing is playing, skip the voices, the mixing and the checks
+    // on the output. The output is silent either way.
+    if (isIdle()) {
+        juce::FloatVectorOperations::clear(outputBufferLeft, sampleCount);
+        if (outputBufferRight != nullptr) {
+            juce::FloatVectorOperations::clear(outputBufferRight, sampleCount);
+        }
+        skipSilence(sampleCount);
+        return;
+    }
+    sampleTime += sampleCount;
+
+    // Whatever the voices play in this block ends up in the decimators.
+    if (numActiveVoices > 0) {
+        silentSamples = 0;
+    } else {
+        silentSamples = std::min(silentSamples + sampleCount, int(Decimator::FLUSH_SAMPLES));
+    }
+
     // The voices need to have access to some of the synth's parameters and
     // MIDI controller values. We copy these values into the active voices
     // at the start of the block. They will never change during the block.
-    for (int v = 0; v < MAX_VOICES; ++v) {
-        Voice& voice = voices[v];
+    for (int i = 0; i < numActiveVoices; ++i) {
+        Voice& voice = voices[activeVoices[i]];
         if (voice.env.isActive()) {
             updatePeriod(voice);
             voice.glideRate = glideRate;
-            voice.filterQ = filterQ * resonanceCtl;
             voice.pitchBend = pitchBend;
             voice.filterEnvDepth = filterEnvDepth;
+            voice.polyBLEP = polyBLEP;
+            voice.leak = integratorLeak;
+            voice.setPreciseMath(preciseMath);
         }
     }
 
-    for (int sample = 0; sample < sampleCount; ++sample) {
+    // The scratch buffers have room for the block size from prepareToPlay.
+    // Hosts sometimes send larger blocks anyway, so render in segments.
+    int sample = 0;
+    while (sample < sampleCount) {
+        int samplesThisSegment = std::min(maxBlockSize, sampleCount - sample);
+        renderSegment(outputBufferLeft + sample,
+                      outputBufferRight != nullptr ? outputBufferRight + sample : nullptr,
+                      samplesThisSegment);
+        sample += samplesThisSegment;
+    }
 
-        // The LFO and any things it modulates are updated every 32 samples.
-        // It's also guaranteed to be called the very first time.
-        updateLFO();
+    // Turn off voices whose envelope has dropped below the minimum level and
+    // remove them from the list of active voices.
+    int stillActive = 0;
+    for (int i = 0; i < numActiveVoices; ++i) {
+        int v = activeVoices[i];
+        Voice& voice = voices[v];
+        if (voice.env.isActive()) {
+            activeVoices[stillActive++] = v;
+        } else {
+            voice.env.reset();
+            voice.filter.reset();
+            allocator.voiceStopped(v);
+        }
+    }
+    numActiveVoices = stillActive;
 
-        // Noise oscillator.
-        float noise = noiseGen.nextValue() * noiseMix;
+    float* channels[2] = { outputBufferLeft, outputBufferRight };
+    for (int channel = 0; channel < 2; ++channel) {
+        OutputProblem problem = protectYourEars(channels[channel], sampleCount, outputProtection);
+        if (problem != OutputProblem::none) {
+            telemetry.push({ TelemetryEvent::outputProblem, int32_t(problem), channel, sampleTime });
+        }
+    }
+}
 
-        // These variables add up the output values of all the active voices.
-        float outputLeft = 0.0f;
-        float outputRight = 0.0f;
+bool Synth::isIdle() const
+{
+    return numActiveVoices == 0
+        && silentSamples >= Decimator::FLUSH_SAMPLES
+        && !noiseMixSmoother.isSmoothing()
+        && !outputLevelSmoother.isSmoothing();
+}
 
-        // Render the voices that have an active envelope.
-        for (int v = 0; v < MAX_VOICES; ++v) {
-            Voice& voice = voices[v];
-            if (voice.env.isActive()) {
-                float output = voice.render(noise);
-                outputLeft += output * voice.panLeft;
-                outputRight += output * voice.panRight;
-            }
+void Synth::skipSilence(int sampleCount)
+{
+    jassert(isIdle());
+
+    // The LFO keeps running while the synth is silent, so that the next note
+    // starts at the same LFO phase as it would have otherwise. This updates
+    // the LFO on the same samples as renderSegment does.
+    const int internalCount = sampleCount * oversampling;
+    ControlStep step;
+    int sample = 0;
+    while (sample < internalCount) {
+        updateLFO(step);
+        int samplesThisStep = std::min(lfoStep, internalCount - sample);
+        lfoStep -= samplesThisStep;
+        sample += samplesThisStep;
+    }
+
+    // The noise is generated for every sample, even without voices to use
+    // it. The smoothers aren't ramping, so they don't need to move.
+    noiseGen.skip(internalCount);
+    sampleTime += sampleCount;
+}
+
+void Synth::renderSegment(float* outputBufferLeft, float* outputBufferRight, int sampleCount)
+{
+    // Everything up to the mix of the voices happens at the oversampled rate.
+    const int internalCount = sampleCount * oversampling;
+
+    // Divide the segment into control steps. The LFO and anything it modulates
+    // is only updated at the start of a step. Each voice renders the entire
+    // segment in one go, so the modulation values for all the steps must be
+    // known up front.
+    numSteps = 0;
+    int sample = 0;
+    while (sample < internalCount) {
+        ControlStep& step = steps[size_t(numSteps++)];
+
+        // The LFO and any things it modulates are updated once per control
+        // period. It's also guaranteed to be called the very first time. This
+        // tells us how many samples are left until the next update.
+        updateLFO(step);
+        step.start = sample;
+        step.sampleCount = std::min(lfoStep, internalCount - sample);
+        lfoStep -= step.sampleCount;
+        sample += step.sampleCount;
+    }
+    segmentLength = internalCount;
+
+    // Noise oscillator. This is shared by all voices.
+    for (int i = 0; i < internalCount; ++i) {
+        noiseBuffer[size_t(i)] = noiseGen.nextValue() * noiseMixSmoother.getNextValue();
+    }
+
+    // Put the playing voices into groups.
+    numGroupVoices = 0;
+    for (int i = 0; i < numActiveVoices; ++i) {
+        Voice& voice = voices[activeVoices[i]];
+        if (voice.env.isActive()) {
+            groupVoices[numGroupVoices++] = &voice;
+        }
+    }
+    int numGroups = (numGroupVoices + VoiceBank::LANES - 1) / VoiceBank::LANES;
+
+    // Only use the worker threads if there is enough work to do. Rendering a
+    // group is exactly the same on any thread, so this doesn't change the
+    // output, only how long it takes.
+    if (threadPool.getNumThreads() > 0
+            && numGroupVoices >= MIN_THREADED_VOICES
+            && internalCount >= MIN_THREADED_SAMPLES) {
+        threadPool.run(renderGroupJob, this, numGroups);
+    } else {
+        for (int group = 0; group < numGroups; ++group) {
+            renderGroup(group, 0);
         }
+    }
+
+    // Add up the groups. Always do this in the same order, because floating
+    // point addition gives slightly different results in a different order.
+    juce::FloatVectorOperations::clear(mixLeft.data(), internalCount);
+    juce::FloatVectorOperations::clear(mixRight.data(), internalCount);
+    for (int group = 0; group < numGroups; ++group) {
+        const float* groupLeft = groupBuffers.data() + group * 2 * maxInternalSize;
+        const float* groupRight = groupLeft + maxInternalSize;
+        juce::FloatVectorOperations::add(mixLeft.data(), groupLeft, internalCount);
+        juce::FloatVectorOperations::add(mixRight.data(), groupRight, internalCount);
+    }
+
+    // Go back to the host's sample rate. This leaves the first `sampleCount`
+    // samples of the mix buffers. Without oversampling it does nothing.
+    decimatorLeft.process(mixLeft.data(), mixLeft.data(), sampleCount, oversampling);
+    decimatorRight.process(mixRight.data(), mixRight.data(), sampleCount, oversampling);
 
-        // Apply additional gain.
+    // Apply additional gain and write the result into the output buffer.
+    for (int i = 0; i < sampleCount; ++i) {
         float outputLevel = outputLevelSmoother.getNextValue();
-        outputLeft *= outputLevel;
-        outputRight *= outputLevel;
+        float outputLeft = mixLeft[size_t(i)] * outputLevel;
+        float outputRight = mixRight[size_t(i)] * outputLevel;
 
-        // Write the result into the output buffer.
         if (outputBufferRight != nullptr) {
-            outputBufferLeft[sample] = outputLeft;
-            outputBufferRight[sample] = outputRight;
+            outputBufferLeft[i] = outputLeft;
+            outputBufferRight[i] = outputRight;
         } else {
-            outputBufferLeft[sample] = (outputLeft + outputRight) * 0.5f;
+            outputBufferLeft[i] = (outputLeft + outputRight) * 0.5f;
         }
     }
+}
 
-    // Turn off voices whose envelope has dropped below the minimum level.
-    for (int v = 0; v < MAX_VOICES; ++v) {
-        Voice& voice = voices[v];
-        if (!voice.env.isActive()) {
-            voice.env.reset();
-            voice.filter.reset();
+void Synth::renderGroupJob(void* context, int group, int thread)
+{
+    static_cast<Synth*>(context)->renderGroup(group, thread);
+}
+
+void Synth::renderGroup(int group, int thread)
+{
+    int first = group * VoiceBank::LANES;
+    int count = std::min(VoiceBank::LANES, numGroupVoices - first);
+
+    float* outputLeft = groupBuffers.data() + group * 2 * maxInternalSize;
+    float* outputRight = outputLeft + maxInternalSize;
+    juce::FloatVectorOperations::clear(outputLeft, segmentLength);
+    juce::FloatVectorOperations::clear(outputRight, segmentLength);
+
+    if (useVoiceBank) {
+        renderGroupVoiceBank(&groupVoices[size_t(first)], count, thread, outputLeft, outputRight);
+    } else {
+        renderGroupVoices(&groupVoices[size_t(first)], count, thread, outputLeft, outputRight);
+    }
+}
+
+void Synth::renderGroupVoices(Voice* const* voicesInGroup, int count, int thread,
+                              float* outputLeft, float* outputRight)
+{
+    // Render one voice at a time. Each voice renders into a scratch buffer,
+    // which then gets panned and added to the group's output.
+    float* voiceOutput = renderContexts[size_t(thread)].voiceBuffer.data();
+
+    for (int v = 0; v < count; ++v) {
+        Voice& voice = *voicesInGroup[v];
+        for (int s = 0; s < numSteps; ++s) {
+            const ControlStep& step = steps[size_t(s)];
+            if (!voice.env.isActive()) {
+                juce::FloatVectorOperations::clear(voiceOutput + step.start, segmentLength - step.start);
+                break;
+            }
+            if (step.updateLFO) {
+                updateVoiceLFO(voice, step);
+            }
+            voice.renderBlock(noiseBuffer.data() + step.start, voiceOutput + step.start, step.sampleCount);
         }
+        juce::FloatVectorOperations::addWithMultiply(outputLeft, voiceOutput, voice.panLeft, segmentLength);
+        juce::FloatVectorOperations::addWithMultiply(outputRight, voiceOutput, voice.panRight, segmentLength);
+    }
+}
+
+void Synth::renderGroupVoiceBank(Voice* const* voicesInGroup, int count, int thread,
+                                 float* outputLeft, float* outputRight)
+{
+    // Render all the voices from the group at once, one control step at a time.
+    VoiceBank& voiceBank = renderContexts[size_t(thread)].voiceBank;
+
+    for (int s = 0; s < numSteps; ++s) {
+        const ControlStep& step = steps[size_t(s)];
+
+        Voice* lanes[VoiceBank::LANES];
+        int numLanes = 0;
+        for (int v = 0; v < count; ++v) {
+            Voice& voice = *voicesInGroup[v];
+            if (voice.env.isActive()) {
+                lanes[numLanes++] = &voice;
+            }
+        }
+        if (numLanes == 0) { break; }
+
+        if (step.updateLFO) {
+            updateGroupLFO(lanes, numLanes, step);
+        }
+
+        voiceBank.load(lanes, numLanes);
+        voiceBank.render(noiseBuffer.data() + step.start, outputLeft + step.start,
+                         outputRight + step.start, step.sampleCount);
+        voiceBank.store();
+    }
+}
+
+void Synth::updateVoiceLFO(Voice& voice, const ControlStep& step)
+{
+    // Perform any computations that depend on the LFO modulations.
+    setVoiceModulation(voice, step);
+    voice.updateLFO();
+    updatePeriod(voice);
+}
+
+void Synth::updateGroupLFO(Voice* const* voicesInGroup, int count, const ControlStep& step)
+{
+    // This is updateVoiceLFO, but Voice::updateLFO is split in two around
+    // the exp(), so that it can be done with SIMD. That gives exactly the
+    // same results, see FastMath.h. Unused lanes get exp(0).
+    alignas(VoiceBank::SIMD::SIMDRegisterSize) float exponents[VoiceBank::LANES] = {};
+    for (int v = 0; v < count; ++v) {
+        setVoiceModulation(*voicesInGroup[v], step);
+        exponents[v] = voicesInGroup[v]->updateGlide();
+    }
+
+    alignas(VoiceBank::SIMD::SIMDRegisterSize) float modulations[VoiceBank::LANES];
+    FastMath::exp(VoiceBank::SIMD::fromRawArray(exponents), preciseMath).copyToRawArray(modulations);
+
+    for (int v = 0; v < count; ++v) {
+        voicesInGroup[v]->updateCutoff(modulations[v]);
+        updatePeriod(*voicesInGroup[v]);
     }
+}
 
-    protectYourEars(outputBufferLeft, sampleCount);
-    protectYourEars(outputBufferRight, sampleCount);
+void Synth::setVoiceModulation(Voice& voice, const ControlStep& step)
+{
+    voice.osc1.modulation = step.vibratoMod;
+    voice.osc2.modulation = step.pwm;
+    voice.osc2.amplitude = voice.osc1.amplitude * step.oscMix;
+    voice.filterMod = step.filterMod;
+    voice.filterQ = step.filterQ;
+    voice.filter.rampLength = controlPeriod;
 }
 
-void Synth::updateLFO()
+void Synth::updateLFO(ControlStep& step)
 {
-    if (--lfoStep <= 0) {
-        lfoStep = LFO_MAX;  // reset the counter
+    step.updateLFO = (lfoStep <= 0);
+    if (step.updateLFO) {
+        lfoStep = controlPeriod;  // reset the counter
 
         lfo += lfoInc;
         if (lfo > PI) { lfo -= TWO_PI; }
@@ -146,70 +493,64 @@ void Synth::updateLFO()
         // The modulation intensity for vibrato / PWM is set by the parameter
         // and by the modulation wheel. Together, they can modulate the pitch
         // by approximately two semitones up and down.
-        float vibratoMod = 1.0f + sine * (modWheel + vibrato);
-        float pwm = 1.0f + sine * (modWheel + pwmDepth);
+        step.vibratoMod = 1.0f + sine * (modWheel + vibrato);
+        step.pwm = 1.0f + sine * (modWheel + pwmDepth);
 
         // The low-pass filter cutoff is modulated by the combination of the
         // Filter Freq parameter set by the user, the MIDI CC, aftertouch, and
         // the LFO intensity. This value swings between approx -7.97 and 11.7.
         // The Voice will also add the filter envelope to this.
-        float filterMod = filterKeyTracking + filterCtl + (filterLFODepth + pressure) * sine;
+        float filterMod = filterKeyTrackingSmoother.skip(controlPeriod) + filterCtl
+                        + (filterLFODepth + pressure) * sine;
 
         // Use a basic one-pole smoothing filter to de-zipper changes to the
         // amount of filter modulation.
         filterZip += 0.005f * (filterMod - filterZip);
+        step.filterMod = filterZip;
 
-        // Tell all active voices to perform any computations that depend on
-        // the LFO modulations.
-        for (int v = 0; v < MAX_VOICES; ++v) {
-            Voice& voice = voices[v];
-            if (voice.env.isActive()) {
-                voice.osc1.modulation = vibratoMod;
-                voice.osc2.modulation = pwm;
-                voice.filterMod = filterZip;
-                voice.updateLFO();
-                updatePeriod(voice);
-            }
-        }
+        // These parameters are smoothed at the LFO update rate too.
+        step.filterQ = filterQSmoother.skip(controlPeriod) * resonanceCtl;
+        step.oscMix = oscMixSmoother.skip(controlPeriod);
     }
 }
 
 void Synth::midiMessage(uint8_t data0, uint8_t data1, uint8_t data2)
 {
-    switch (data0 & 0xF0) {  // status byte (all channels)
-        // Note off
-        case 0x80:
-            noteOff(data1 & 0x7F);
+    const uint8_t data[3] = { data0, data1, data2 };
+    SynthEvent event;
+    if (SynthEvent::decode(data, 3, 0, event)) {
+        handleEvent(event);
+    }
+}
+
+void Synth::handleEvent(const SynthEvent& event)
+{
+    switch (event.type) {
+        case SynthEvent::Type::noteOff:
+            noteOff(event.number);
             break;
 
-        // Note on
-        case 0x90: {
-            uint8_t note = data1 & 0x7F;
-            uint8_t velo = data2 & 0x7F;
-            if (velo > 0) {
-                noteOn(note, velo);
-            } else {
-                noteOff(note);
-            }
+        case SynthEvent::Type::noteOn:
+            noteOn(event.number, event.value);
             break;
-        }
 
-        // Control change
-        case 0xB0:
-            controlChange(data1, data2);
+        case SynthEvent::Type::controlChange:
+            controlChange(event.number, uint8_t(event.value));
             break;
 
         // Channel aftertouch
-        case 0xD0:
+        case SynthEvent::Type::pressure:
             // This maps the pressure value to a parabolic curve starting at
             // 0.0 (position 0) up to 1.61 (position 127).
-            pressure = 0.0001f * float(data1 * data1);
+            pressure = 0.0001f * float(event.value * event.value);
             break;
 
-        // Pitch bend
-        case 0xE0:
+        case SynthEvent::Type::pitchBend:
             // The pitch wheel can shift the tone up or down by 2 semitones.
-            pitchBend = std::exp(-0.000014102f * float(data1 + 128 * data2 - 8192));
+            pitchBend = std::exp(-0.000014102f * float(event.value));
+            break;
+
+        case SynthEvent::Type::programChange:
             break;
     }
 }
@@ -236,19 +577,16 @@ void Synth::controlChange(uint8_t data1, uint8_t data2)
 
         // Resonance
         case 0x47:
-        case 0x17:  // knob on my MIDI controller
             resonanceCtl = 154.0f / float(154 - data2);
             break;
 
         // Filter +
         case 0x4A:
-        case 0x15:  // knob on my MIDI controller
             filterCtl = 0.02f * float(data2);
             break;
 
         // Filter -
         case 0x4B:
-        case 0x16:  // knob on my MIDI controller
             filterCtl = -0.03f * float(data2);
             break;
 
@@ -257,7 +595,9 @@ void Synth::controlChange(uint8_t data1, uint8_t data2)
             if (data1 >= 0x78) {
                 for (int v = 0; v < MAX_VOICES; ++v) {
                     voices[v].reset();
+                    allocator.setNote(v, 0);
                 }
+                noteStack.clear();
                 sustainPedalPressed = false;
             }
             break;
@@ -272,12 +612,30 @@ void Synth::noteOn(int note, int velocity)
 
     if (numVoices == 1) {  // monophonic
         if (voices[0].note > 0) {  // legato-style playing
-            shiftQueuedNotes();
+            // Remember the key that was playing, so that it comes back when
+            // the new key is released.
+            noteStack.push(voices[0].note);
+
+            // Edge case: the user is playing multiple notes in polyphonic
+            // mode and switches to monophonic mode. We then need to fade out
+            // all the other voices or they would keep ringing forever.
+            for (int i = 0; i < numActiveVoices; ++i) {
+                if (activeVoices[i] != 0) {
+                    voices[activeVoices[i]].release();
+                }
+            }
+
             restartMonoVoice(note, velocity);
             return;
         }
     } else {  // polyphonic
-        v = findFreeVoice();
+        noteStack.clear();
+        v = allocator.chooseVoice(note, numVoices, voices.data(), stealPolicy);
+
+        // This includes playing the same note on the same voice again.
+        if (allocator.isPlaying(v)) {
+            telemetry.push({ TelemetryEvent::voiceStolen, v, note, sampleTime });
+        }
     }
 
     startVoice(v, note, velocity);
@@ -287,8 +645,8 @@ void Synth::noteOff(int note)
 {
     // In monophonic mode and the currently playing note is released?
     if ((numVoices == 1) && (voices[0].note == note)) {
-        // Did we find an older note whose key is still held down?
-        int queuedNote = nextQueuedNote();
+        // Is an older key still held down?
+        int queuedNote = noteStack.pop();
         if (queuedNote > 0) {
             // Put this note into voice 0 and restart it.
             restartMonoVoice(queuedNote, -1);
@@ -300,21 +658,45 @@ void Synth::noteOff(int note)
     // We also get here when the sustain pedal is released. In that case,
     // the note number is -1 (SUSTAIN).
 
-    for (int v = 0; v < MAX_VOICES; v++) {
-        // Any voices playing this note?
-        if (voices[v].note == note) {
-            if (sustainPedalPressed) {
-                // Sustain pedal is pressed, so put the note in sustain mode.
-                voices[v].note = SUSTAIN;
-            } else {
-                // Sustain pedal is not pressed, so start envelope release.
-                voices[v].release();
-                voices[v].note = 0;
-            }
+    // Any voices playing this note? The allocator knows which ones they are.
+    allocator.voicesPlaying(note).forEach([this, note](int v) { releaseVoice(v, note); });
+
+    // In monophonic mode, forget the key if it was waiting on the stack. The
+    // mono voice may also have stopped by itself while the key was held.
+    if (numVoices == 1) {
+        noteStack.remove(note);
+        if (!allocator.isPlaying(0)) { releaseVoice(0, note); }
+    }
+}
+
+void Synth::releaseVoice(int v, int note)
+{
+    if (voices[v].note == note) {
+        if (sustainPedalPressed) {
+            // Sustain pedal is pressed, so put the note in sustain mode.
+            setVoiceNote(v, SUSTAIN);
+        } else {
+            // Sustain pedal is not pressed, so start envelope release.
+            voices[v].release();
+            setVoiceNote(v, 0);
         }
     }
 }
 
+void Synth::addActiveVoice(int v)
+{
+    if (!allocator.isPlaying(v)) {
+        allocator.voiceStarted(v);
+        activeVoices[numActiveVoices++] = v;
+    }
+}
+
+void Synth::setVoiceNote(int v, int note)
+{
+    voices[v].note = note;
+    allocator.setNote(v, note);
+}
+
 void Synth::startVoice(int v, int note, int velocity)
 {
     float period = calcPeriod(v, note);
@@ -336,7 +718,7 @@ void Synth::startVoice(int v, int note, int velocity)
     // If gliding, make the starting period equal to the period of the previous
     // note. Also offset it by an additional amount of glide bending, given in
     // semitones. `glideBend` is always used, even if gliding is disabled.
-    voice.period = period * std::pow(1.059463094359f, float(noteDistance) - glideBend);
+    voice.period = period * FastMath::exp2((float(noteDistance) - glideBend) / 12.0f, preciseMath);
 
     // Make sure the starting period does not become too small. Unlike the
     // target period, this doesn't need to be exact, so we can simply limit
@@ -345,13 +727,15 @@ void Synth::startVoice(int v, int note, int velocity)
 
     // Remember which note was last played, for gliding next time.
     lastNote = note;
-    voice.note = note;
+    setVoiceNote(v, note);
+    allocator.noteStarted(v, note);
+    voice.setPreciseMath(preciseMath);
     voice.updatePanning();
 
     // Set the base cutoff frequency for the low-pass filter, based on the
     // pitch of the note and its velocity.
-    voice.cutoff = sampleRate / (period * PI);
-    voice.cutoff *= std::exp(velocitySensitivity * float(velocity - 64));
+    voice.cutoff = internalSampleRate / (period * PI);
+    voice.cutoff *= FastMath::exp(velocitySensitivity * float(velocity - 64), preciseMath);
 
     // The loudness of the tone uses the MIDI velocity but you cannot set the
     // sensitivity other than on/off. Convert the linear velocity into a curve
@@ -361,7 +745,7 @@ void Synth::startVoice(int v, int note, int velocity)
     // Use the different volume controls to set the amplitude level (a value
     // between 0 and 1) for both oscillators.
     voice.osc1.amplitude = volumeTrim * vel;
-    voice.osc2.amplitude = voice.osc1.amplitude * oscMix;
+    voice.osc2.amplitude = voice.osc1.amplitude * oscMixSmoother.getCurrentValue();
 
     // OPTIONAL: reset the oscillators.
     //voice.osc1.reset();
@@ -387,6 +771,8 @@ void Synth::startVoice(int v, int note, int velocity)
     filterEnv.sustainLevel = filterSustain;
     filterEnv.releaseMultiplier = filterRelease;
     filterEnv.attack();
+
+    addActiveVoice(v);
 }
 
 void Synth::restartMonoVoice(int note, int velocity)
@@ -407,23 +793,27 @@ void Synth::restartMonoVoice(int note, int velocity)
     // Same formula as in startVoice. When playing a queued note we do not have
     // the velocity anymore, so just ignore that part when setting the low-pass
     // filter cutoff.
-    voice.cutoff = sampleRate / (period * PI);
+    voice.cutoff = internalSampleRate / (period * PI);
     if (velocity > 0) {
-        voice.cutoff *= std::exp(velocitySensitivity * float(velocity - 64));
+        voice.cutoff *= FastMath::exp(velocitySensitivity * float(velocity - 64), preciseMath);
     }
 
     voice.env.level += SILENCE + SILENCE;
-    voice.note = note;
+    setVoiceNote(0, note);
+    allocator.noteStarted(0, note);
+    voice.setPreciseMath(preciseMath);
     voice.updatePanning();
+
+    addActiveVoice(0);
 }
 
 float Synth::calcPeriod(int v, int note) const
 {
     // Calculate the period in samples. This formula may look complicated but
     // is explained in detail in the book.
-    // The ANALOG term adds a small amount of detuning based on the current
-    // voice number. For moar analog!
-    float period = tune * std::exp(-0.05776226505f * (float(note) + ANALOG * float(v)));
+    // The analogDrift term adds a small amount of detuning based on the
+    // current voice number. For moar analog!
+    float period = tune * FastMath::exp(-0.05776226505f * (float(note) + analogDrift(v)), preciseMath);
 
     // Make sure the period does not become too small. This lowers the pitch an
     // octave at a time until `period` is at least six samples long.
@@ -432,68 +822,10 @@ float Synth::calcPeriod(int v, int note) const
     return period;
 }
 
-int Synth::findFreeVoice() const
-{
-    int v = 0;
-    float l = 100.0f;  // louder than any envelope!
-
-    for (int i = 0; i < MAX_VOICES; ++i) {
-        // Replace quietest voice not in attack. This will first use any voices
-        // that are not playing (with env level = 0.0). If all are in use, pick
-        // the voice with the lowest envelope value.
-        if (voices[i].env.level < l && !voices[i].env.isInAttack()) {
-            l = voices[i].env.level;
-            v = i;
-        }
-    }
-    return v;
-}
-
-void Synth::shiftQueuedNotes()
-{
-    // Queue any held notes. This puts the previous note numbers into the other
-    // Voice objects, but it won't actually play these voices. Used during the
-    // next Note Off event to determine which note to restore.
-    for (int tmp = MAX_VOICES - 1; tmp > 0; tmp--) {
-        voices[tmp].note = voices[tmp - 1].note;
-
-        // Edge case: the user is playing multiple notes in polyphonic mode
-        // and switches to monophonic mode. We then need to fade out all the
-        // other voices or they would keep ringing forever.
-        voices[tmp].release();
-    }
-}
-
-int Synth::nextQueuedNote()
-{
-    // Are there any older notes queued? Note that some of these may have
-    // been released in the mean time, in which case `voice.note` was set
-    // to 0 or SUSTAIN (in the loop from the else clause below). This means
-    // notes kept alive only by the sustain pedal are not restored.
-    int held = 0;
-    for (int v = MAX_VOICES - 1; v > 0; v--) {
-        if (voices[v].note > 0) { held = v; }
-    }
-
-    // Remove this older note from the queue.
-    if (held > 0) {
-        int note = voices[held].note;
-        voices[held].note = 0;
-        return note;
-    }
-
-    // No notes in the queue.
-    return 0;
-}
-
 bool Synth::isPlayingLegatoStyle() const
 {
-    int held = 0;
-    for (int i = 0; i < MAX_VOICES; ++i) {
-        // Count how many playing voices are for keys that are still held down,
-        // i.e. that did not get a Note Off event yet. If note is 0, this voice
-        // is not playing; if it's -1, the note is sustained by the pedal.
-        if (voices[i].note > 0) { held += 1; }
-    }
-    return held > 0;
+    // Are there playing voices for keys that are still held down, i.e. that
+    // did not get a Note Off event yet? Voices that are only sustained by
+    // the pedal don't count.
+    return allocator.isAnyNoteHeld();
 }
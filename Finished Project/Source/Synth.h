@@ -2,7 +2,14 @@
 
 #include <JuceHeader.h>
 #include "Voice.h"
+#include "VoiceBank.h"
+#include "VoiceThreadPool.h"
+#include "VoiceAllocator.h"
 #include "NoiseGenerator.h"
+#include "Decimator.h"
+#include "Utils.h"
+#include "Telemetry.h"
+#include "EventQueue.h"
 
 // The main class for the synthesizer.
 class Synth
@@ -16,10 +23,14 @@ public:
     void render(float** outputBuffers, int sampleCount);
     void midiMessage(uint8_t data0, uint8_t data1, uint8_t data2);
 
+    // The same as midiMessage, for an event that is already decoded. The
+    // position of the event is ignored. Program changes do nothing here.
+    void handleEvent(const SynthEvent& event);
+
     // === Parameter values ===
 
-    // Gain for mixing noise into the output.
-    float noiseMix;
+    // Gain for mixing noise into the output. Smoothed per sample.
+    juce::LinearSmoothedValue<float> noiseMixSmoother;
 
     // Amplitude ADSR settings.
     float envAttack, envDecay, envSustain, envRelease;
@@ -27,7 +38,17 @@ public:
     // How much oscillator 2 is mixed into the sound. 0.0 = osc2 is silent,
     // 1.0 = osc2 has same level as osc1. Note that osc2 is subtracted, so if
     // it is not detuned from osc1, they cancel each other out into silence.
-    float oscMix;
+    // Smoothed at the LFO update rate.
+    juce::LinearSmoothedValue<float> oscMixSmoother;
+
+    // Use the PolyBLEP sawtooth instead of the BLIT oscillators. This is
+    // cheaper, the BLIT has less aliasing.
+    bool polyBLEP;
+
+    // Use the standard library for exp, sin, cos and tan, and for the filter
+    // cutoff instead of the lookup table. This costs more CPU time, see
+    // FastMath.h for how small the difference is.
+    bool preciseMath;
 
     // Amount of detuning for oscillator 2. This is a multiplier for the period
     // of the oscillator.
@@ -36,12 +57,43 @@ public:
     // Master tuning.
     float tune;
 
-    // Max polyphony.
-    static constexpr int MAX_VOICES = 8;
+    // Size of the voice pool. This is the maximum polyphony.
+    static constexpr int MAX_VOICES = 128;
 
-    // Mono (= 1 voice) / poly mode.
+    // How many voices may be used: 1 = mono mode, or up to MAX_VOICES in
+    // poly mode. This can be changed at any time.
     int numVoices;
 
+    // Number of voices that are currently playing.
+    int getNumActiveVoices() const { return numActiveVoices; }
+
+    // True when render would only write zeros: no voices are playing, the
+    // last sound has left the decimators, and the smoothers that run on
+    // every sample are not ramping. The next render is then a lot cheaper.
+    bool isIdle() const;
+
+    // Moves the LFO and the noise generator ahead by `sampleCount` samples
+    // without producing any output, exactly like rendering that many samples
+    // of silence does. Only call this when the synth is idle.
+    void skipSilence(int sampleCount);
+
+    // How often the output had to be silenced or clamped. The plug-in's
+    // other threads can read these while the synth is rendering.
+    OutputProtectionCounters outputProtection;
+
+    // Reports voice steals and problems with the output from the audio
+    // thread. Whoever owns the synth should empty this regularly, for
+    // example with a TelemetryLogger.
+    TelemetryQueue telemetry;
+
+    // Number of samples rendered since the synth was created, at the host's
+    // sample rate. This is the time in the telemetry records.
+    int64_t getSampleTime() const { return sampleTime; }
+
+    // How to choose a voice to steal in poly mode when all of them are
+    // playing. This can be changed at any time.
+    VoiceAllocator::Policy stealPolicy;
+
     // Used to keep the output gain constant after changing parameters.
     float volumeTrim;
 
@@ -56,8 +108,41 @@ public:
     // If this is set, all notes will be played with the same velocity.
     bool ignoreVelocity;
 
-    // How often the LFO and other modulations are updated, in samples.
-    const int LFO_MAX = 32;
+    // How often the LFO, glide, filter envelope and filter cutoff are updated,
+    // in samples. Shorter periods give smoother modulation but cost more CPU.
+    // This can be changed at any time; it takes effect at the next update.
+    int controlPeriod;
+
+    // Limits for controlPeriod.
+    static constexpr int MIN_CONTROL_PERIOD = 8;
+    static constexpr int MAX_CONTROL_PERIOD = 256;
+
+    // The number of samples at the oversampled rate until the next control
+    // step starts. The mod wheel, aftertouch and filter controllers only take
+    // effect at the start of a control step; see EventScheduler.
+    int getSamplesUntilControlUpdate() const { return std::max(lfoStep, 0); }
+
+    // The voices can run at 2 or 4 times the sample rate, which gives less
+    // aliasing from the oscillators and lets the filter work properly close
+    // to 20 kHz. Their output is brought back to the host's sample rate with
+    // half-band filters, see Decimator.h. The voices that are playing keep
+    // their pitch and envelope timing when this changes, but all settings
+    // that depend on the sample rate must be recalculated for the new rate;
+    // applyParameters does this. The half-band filters start over with the
+    // new delay, so there may be a short click. Don't call it during render.
+    void setOversampling(int factor);
+    int getOversampling() const { return oversampling; }
+
+    // How many samples the half-band filters delay the output by, which the
+    // plug-in reports to the host as its latency.
+    int getLatency() const { return Decimator::getLatency(oversampling); }
+
+    static constexpr int MAX_OVERSAMPLING = Decimator::MAX_FACTOR;
+
+    // The sample rate that the voices run at, which is the host's sample
+    // rate times the oversampling factor. All settings measured in samples,
+    // including controlPeriod, are for this rate.
+    float getInternalSampleRate() const { return internalSampleRate; }
 
     // Phase increment for the LFO.
     float lfoInc;
@@ -78,11 +163,13 @@ public:
 
     // The user does not manually set the filter's cutoff frequency, this is
     // determined by the note's pitch and velocity. This variable is used as
-    // a multiplier that shifts the cutoff up or down.
-    float filterKeyTracking;
+    // a multiplier that shifts the cutoff up or down. Smoothed at the LFO
+    // update rate.
+    juce::LinearSmoothedValue<float> filterKeyTrackingSmoother;
 
-    // Resonance setting for the low-pass filter.
-    float filterQ;
+    // Resonance setting for the low-pass filter. Smoothed at the LFO update
+    // rate.
+    juce::LinearSmoothedValue<float> filterQSmoother;
 
     // LFO intensity for the filter cutoff.
     float filterLFODepth;
@@ -93,9 +180,70 @@ public:
     // Envelope intensity for the filter cutoff.
     float filterEnvDepth;
 
+    // Render the voices with SIMD, several at a time (true), or one voice
+    // at a time (false). Both give the same results, see VoiceBank.h.
+    bool useVoiceBank;
+
+    // Number of worker threads that help the audio thread render the voices.
+    // 0 renders everything on the audio thread. The threads are started by
+    // allocateResources, so set this before calling that, or call
+    // startWorkerThreads afterwards.
+    int numWorkerThreads;
+
+    // Stops the worker threads and starts numWorkerThreads new ones. This
+    // allocates memory, so don't call it while render may be running.
+    void startWorkerThreads();
+
+    // Below these amounts, waking up the worker threads costs more time than
+    // it saves, and all voices are rendered on the audio thread instead.
+    static constexpr int MIN_THREADED_VOICES = 16;
+    static constexpr int MIN_THREADED_SAMPLES = 64;
+
+    // The oscillator drift of voice `v`, in semitones. Each voice is a tiny
+    // bit flatter than the one before it, like the oscillators of an analog
+    // synth. This repeats every 8 voices, so that the drift stays below 0.014
+    // semitones no matter how many voices there are.
+    static float analogDrift(int v) { return 0.002f * float(v % 8); }
+
 private:
-    // Performs the LFO update very 32 samples.
-    void updateLFO();
+    // Modulation values for one control step. The voices only look at these
+    // if `updateLFO` is true; the first step in a block may be the remainder
+    // of the previous block's control period.
+    struct ControlStep
+    {
+        int start;
+        int sampleCount;
+        bool updateLFO;
+        float vibratoMod;
+        float pwm;
+        float filterMod;
+        float filterQ;
+        float oscMix;
+    };
+
+    // Renders at most `maxBlockSize` samples.
+    void renderSegment(float* outputBufferLeft, float* outputBufferRight, int sampleCount);
+
+    // Performs the LFO update once per control period. This fills in the
+    // modulation values for the next control step.
+    void updateLFO(ControlStep& step);
+
+    // The voices are rendered in groups of VoiceBank::LANES voices. Each group
+    // is a job for the thread pool. `thread` says which scratch memory to use.
+    static void renderGroupJob(void* context, int group, int thread);
+    void renderGroup(int group, int thread);
+    void renderGroupVoices(Voice* const* voicesInGroup, int count, int thread,
+                           float* outputLeft, float* outputRight);
+    void renderGroupVoiceBank(Voice* const* voicesInGroup, int count, int thread,
+                              float* outputLeft, float* outputRight);
+
+    // Gives the voice the modulation values for this control step.
+    void updateVoiceLFO(Voice& voice, const ControlStep& step);
+
+    // The same for a group of up to VoiceBank::LANES voices. This does the
+    // exp() for the cutoff modulation of all the voices at once.
+    void updateGroupLFO(Voice* const* voicesInGroup, int count, const ControlStep& step);
+    void setVoiceModulation(Voice& voice, const ControlStep& step);
 
     // Handles a MIDI CC event.
     void controlChange(uint8_t data1, uint8_t data2);
@@ -106,6 +254,15 @@ private:
     // Handles a MIDI note off event.
     void noteOff(int note);
 
+    // Releases voice `v` if it is playing the given note.
+    void releaseVoice(int v, int note);
+
+    // Puts a voice on the list of active voices, if it isn't already.
+    void addActiveVoice(int v);
+
+    // Changes Voice::note and tells the allocator about it.
+    void setVoiceNote(int v, int note);
+
     // Helper functions that set up a voice to play a new note.
     void startVoice(int v, int note, int velocity);
     void restartMonoVoice(int note, int velocity);
@@ -113,13 +270,6 @@ private:
     // Calculate the oscillator period based on the MIDI note number.
     float calcPeriod(int v, int note) const;
 
-    // Find a voice to use in polyphonic mode.
-    int findFreeVoice() const;
-
-    // For note queuing in monophonic mode.
-    void shiftQueuedNotes();
-    int nextQueuedNote();
-
     inline void updatePeriod(Voice& voice)
     {
         voice.osc1.period = voice.period * pitchBend;
@@ -129,22 +279,100 @@ private:
     // Is at least one key still held down for any of the playing voices?
     bool isPlayingLegatoStyle() const;
 
+    // Points the filters to the sample rate and cutoff table for the current
+    // oversampling factor.
+    void updateInternalSampleRate();
+
     // The current sample rate.
     float sampleRate;
 
-    // List of the active voices.
+    // The oversampling factor and the sample rate that goes with it.
+    int oversampling;
+    float internalSampleRate;
+
+    // The largest number of samples that renderSegment can handle.
+    int maxBlockSize;
+
+    // The same at the highest oversampling factor. The scratch buffers for
+    // the voices have room for this many samples.
+    int maxInternalSize;
+
+    // The pool of voices. Most of these are idle most of the time.
     std::array<Voice, MAX_VOICES> voices;
 
+    // Indices of the voices that are playing, in no particular order. Only
+    // these voices are rendered, so idle voices don't cost anything.
+    std::array<int, MAX_VOICES> activeVoices;
+    int numActiveVoices;
+
+    // How many samples were rendered since the last one with a voice
+    // playing, up to Decimator::FLUSH_SAMPLES.
+    int silentSamples;
+
+    int64_t sampleTime;
+
+    // Keeps track of which voices are in the `activeVoices` list and which
+    // notes they play, and picks the voice for a new note in poly mode.
+    VoiceAllocator allocator;
+
+    // The keys that are held down in mono mode, other than the one that is
+    // playing.
+    NoteStack noteStack;
+
     // Pseudo random noise generator.
     NoiseGenerator noiseGen;
 
+    // Converts the filter cutoff into the filter's g coefficient. Depends on
+    // the sample rate, so they're filled in by allocateResources. There is
+    // one for 1x, 2x and 4x oversampling, so that switching between them
+    // doesn't need to recalculate the table.
+    std::array<CutoffTable, 3> cutoffTables;
+
+    // Coefficient for the BLIT integrator. The leak is per sample, so this
+    // depends on the oversampling factor.
+    float integratorLeak;
+
+    // The control steps for the segment that is being rendered.
+    std::vector<ControlStep> steps;
+    int numSteps;
+    int segmentLength;
+
+    // Which voices go into which group. This is decided before rendering,
+    // so that the groups don't depend on the number of threads.
+    static constexpr int MAX_GROUPS = (MAX_VOICES + VoiceBank::LANES - 1) / VoiceBank::LANES;
+    std::array<Voice*, MAX_VOICES> groupVoices;
+    int numGroupVoices;
+
+    // Output of each group, left and right channel, maxInternalSize samples
+    // each.
+    std::vector<float> groupBuffers;
+
+    // Scratch memory for each thread, including the audio thread.
+    struct RenderContext
+    {
+        VoiceBank voiceBank;
+        std::vector<float> voiceBuffer;
+    };
+    std::vector<RenderContext> renderContexts;
+
+    VoiceThreadPool threadPool;
+
+    // Noise and the mixed output for the segment, maxInternalSize samples.
+    std::vector<float> noiseBuffer;
+    std::vector<float> mixLeft;
+    std::vector<float> mixRight;
+
+    // Filters for bringing the mixed output back to the host's sample rate.
+    Decimator decimatorLeft;
+    Decimator decimatorRight;
+
     // Most recent note that was played. Used for gliding.
     int lastNote;
 
     // === Modulation ===
 
-    // The LFO only updates every 32 samples. This counter keeps track of when
-    // the next update is.
+    // The LFO only updates once per control period. This counter keeps track
+    // of when the next update is.
     int lfoStep;
 
     // Current LFO value.
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+// What happened on the audio thread. The meaning of the values in a
+// TelemetryRecord depends on the event.
+enum class TelemetryEvent : int32_t
+{
+    block,            // value: number of segments, detail: most voices playing
+    parameterUpdate,  // value: the bits of the changed parameters
+    voiceStolen,      // value: the voice, detail: the note it plays now
+    outputProblem,    // value: the OutputProblem, detail: the channel
+    midiLost,         // value: messages ignored, detail: events dropped
+};
+
+// One fixed-size record. `time` is the number of samples that the synth had
+// rendered when this happened.
+struct TelemetryRecord
+{
+    TelemetryEvent event;
+    int32_t value;
+    int32_t detail;
+    int64_t time;
+};
+
+// Sends records from the audio thread to a background thread. This is a ring
+// buffer for a single producer and a single consumer. Both sides only load
+// and store atomics, so neither side ever waits for the other. When the ring
+// is full, new records are thrown away and counted.
+class TelemetryQueue
+{
+public:
+    // Must be a power of two.
+    static constexpr uint32_t CAPACITY = 4096;
+
+    // Only call this from the audio thread.
+    bool push(const TelemetryRecord& record)
+    {
+        const uint32_t write = writeIndex.load(std::memory_order_relaxed);
+        const uint32_t read = readIndex.load(std::memory_order_acquire);
+        if (write - read == CAPACITY) {
+            dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        records[write & (CAPACITY - 1)] = record;
+        writeIndex.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Only call this from the thread that empties the queue.
+    bool pop(TelemetryRecord& record)
+    {
+        const uint32_t read = readIndex.load(std::memory_order_relaxed);
+        const uint32_t write = writeIndex.load(std::memory_order_acquire);
+        if (read == write) {
+            return false;
+        }
+        record = records[read & (CAPACITY - 1)];
+        readIndex.store(read + 1, std::memory_order_release);
+        return true;
+    }
+
+    // How many records didn't fit.
+    uint32_t getNumDropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    // The indices only ever go up. The difference between them is the number
+    // of records in the ring, even after they wrap around.
+    std::atomic<uint32_t> writeIndex { 0 };
+    std::atomic<uint32_t> readIndex { 0 };
+    std::atomic<uint32_t> dropped { 0 };
+    std::array<TelemetryRecord, CAPACITY> records;
+};
+
+// Running totals of the records, for an editor to show. The logger thread
+// updates these, any thread may read them.
+struct TelemetryTotals
+{
+    std::atomic<uint32_t> blocks { 0 };
+    std::atomic<uint32_t> parameterUpdates { 0 };
+    std::atomic<uint32_t> voicesStolen { 0 };
+    std::atomic<uint32_t> outputProblems { 0 };
+    std::atomic<uint32_t> midiIgnored { 0 };
+    std::atomic<uint32_t> midiDropped { 0 };
+    std::atomic<int32_t> peakVoices { 0 };
+    std::atomic<int32_t> peakSegments { 0 };
+
+    void add(const TelemetryRecord& record)
+    {
+        auto increment = [](std::atomic<uint32_t>& total, int32_t amount = 1) {
+            total.store(total.load(std::memory_order_relaxed) + uint32_t(amount),
+                        std::memory_order_relaxed);
+        };
+        auto keepPeak = [](std::atomic<int32_t>& peak, int32_t value) {
+            if (value > peak.load(std::memory_order_relaxed)) {
+                peak.store(value, std::memory_order_relaxed);
+            }
+        };
+        switch (record.event) {
+            case TelemetryEvent::block:
+                increment(blocks);
+                keepPeak(peakSegments, record.value);
+                keepPeak(peakVoices, record.detail);
+                break;
+            case TelemetryEvent::parameterUpdate: increment(parameterUpdates); break;
+            case TelemetryEvent::voiceStolen: increment(voicesStolen); break;
+            case TelemetryEvent::outputProblem: increment(outputProblems); break;
+            case TelemetryEvent::midiLost:
+                increment(midiIgnored, record.value);
+                increment(midiDropped, record.detail);
+                break;
+        }
+    }
+};
+
+// Empties a TelemetryQueue a few times per second on a background thread,
+// keeps the totals, and writes every record to a log file as a line of text:
+//
+//     instance time event value detail
+//
+// where `instance` is a random id that tells apart the plug-ins. Each logger
+// writes its own file, with the instance id added to the name, because
+// plug-ins that share a file would overwrite each other's lines, and on
+// Windows only the first one could open it. The files can simply be joined.
+// Without a log file, this only keeps the totals and never touches the disk.
+class TelemetryLogger : private juce::Thread
+{
+public:
+    explicit TelemetryLogger(TelemetryQueue& queue_)
+        : juce::Thread("JX11 Telemetry"), queue(queue_)
+    {
+        instance = juce::String::toHexString(juce::Random::getSystemRandom().nextInt());
+    }
+
+    ~TelemetryLogger() override
+    {
+        stop();
+    }
+
+    // Starts the thread. For "telemetry.txt" this writes to a file such as
+    // "telemetry-1a2b3c4d.txt" in the same folder. Pass juce::File() to only
+    // keep the totals. Call this from the message thread.
+    void start(const juce::File& logFile_)
+    {
+        stop();
+        logFile = juce::File();
+        if (logFile_.getFullPathName().isNotEmpty()) {
+            logFile = logFile_.getSiblingFile(logFile_.getFileNameWithoutExtension() + "-"
+                                              + instance + logFile_.getFileExtension());
+        }
+        startThread();
+    }
+
+    void stop()
+    {
+        stopThread(1000);
+    }
+
+    // The totals of all the records so far.
+    TelemetryTotals totals;
+
+private:
+    void run() override
+    {
+        std::unique_ptr<juce::FileOutputStream> stream;
+        if (logFile.getFullPathName().isNotEmpty()) {
+            stream = std::make_unique<juce::FileOutputStream>(logFile);
+            if (!stream->openedOk()) {
+                stream.reset();
+            }
+        }
+
+        while (!threadShouldExit()) {
+            wait(200);
+            drain(stream.get());
+        }
+        drain(stream.get());
+    }
+
+    void drain(juce::FileOutputStream* stream)
+    {
+        TelemetryRecord record;
+        while (queue.pop(record)) {
+            totals.add(record);
+            if (stream != nullptr) {
+                *stream << instance << " " << juce::int64(record.time) << " "
+                        << eventName(record.event) << " " << int(record.value) << " "
+                        << int(record.detail) << "\n";
+            }
+        }
+        if (stream != nullptr) {
+            stream->flush();
+        }
+    }
+
+    static const char* eventName(TelemetryEvent event)
+    {
+        switch (event) {
+            case TelemetryEvent::block: return "block";
+            case TelemetryEvent::parameterUpdate: return "parameterUpdate";
+            case TelemetryEvent::voiceStolen: return "voiceStolen";
+            case TelemetryEvent::outputProblem: return "outputProblem";
+            case TelemetryEvent::midiLost: return "midiLost";
+        }
+        return "?";
+    }
+
+    TelemetryQueue& queue;
+    juce::File logFile;
+    juce::String instance;
+};
@@ -1,42 +1,98 @@
 #pragma once
 
+#include <JuceHeader.h>
+#include <atomic>
+
+// How often protectYourEars had to step in, counted per buffer. Only the
+// audio thread changes these, but any thread may read them at any time.
+struct OutputProtectionCounters
+{
+    std::atomic<uint32_t> nan { 0 };      // silenced because of a NaN
+    std::atomic<uint32_t> inf { 0 };      // silenced because of an inf
+    std::atomic<uint32_t> tooLoud { 0 };  // silenced, out of the range [-2, +2]
+    std::atomic<uint32_t> clamped { 0 };  // hard clipped to [-1, +1]
+};
+
+// What protectYourEars did to the buffer.
+enum class OutputProblem : int32_t { none, nan, inf, tooLoud, clamped };
+
 // Silences the buffer if bad or loud values are detected in the output buffer.
-// Use this during debugging to avoid blowing out your eardrums on headphones.
-// If the output value is out of the range [-1, +1] it will be hard clipped.
-inline void protectYourEars(float* buffer, int sampleCount)
+// This avoids blowing out your eardrums on headphones, so it's always on, also
+// in release builds. If the output value is out of the range [-1, +1] it will
+// be hard clipped.
+//
+// This first finds the lowest and highest sample and whether there are any
+// NaNs, in a single SIMD pass over the buffer. Only then does it decide what
+// to do, so a buffer without problems is only read once.
+inline OutputProblem protectYourEars(float* buffer, int sampleCount, OutputProtectionCounters& counters)
 {
-    if (buffer == nullptr) { return; }
-    bool firstWarning = true;
-    for (int i = 0; i < sampleCount; ++i) {
-        float x = buffer[i];
-        bool silence = false;
-        if (std::isnan(x)) {
-            DBG("!!! WARNING: nan detected in audio buffer, silencing !!!");
-            silence = true;
-        } else if (std::isinf(x)) {
-            DBG("!!! WARNING: inf detected in audio buffer, silencing !!!");
-            silence = true;
-        } else if (x < -2.0f || x > 2.0f) {  // screaming feedback
-            DBG("!!! WARNING: sample out of range, silencing !!!");
-            silence = true;
-        } else if (x < -1.0f) {
-            if (firstWarning) {
-                DBG("!!! WARNING: sample out of range, clamping !!!");
-                firstWarning = false;
-            }
-            buffer[i] = -1.0f;
-        } else if (x > 1.0f) {
-            if (firstWarning) {
-                DBG("!!! WARNING: sample out of range, clamping !!!");
-                firstWarning = false;
-            }
-            buffer[i] = 1.0f;
+    if (buffer == nullptr) { return OutputProblem::none; }
+
+    using SIMD = juce::dsp::SIMDRegister<float>;
+    const int lanes = int(SIMD::size());
+
+    float lowest = 0.0f;
+    float highest = 0.0f;
+    bool nan = false;
+
+    // NaN is the only value that is not equal to itself. It doesn't always
+    // make it through min and max, so it needs its own check.
+    auto scan = [&](float x) {
+        lowest = std::min(lowest, x);
+        highest = std::max(highest, x);
+        nan = nan || (x != x);
+    };
+
+    // The buffer may start anywhere, because processBlock splits it up at the
+    // MIDI events, but SIMDRegister can only load from aligned memory.
+    int i = 0;
+    while (i < sampleCount && !SIMD::isSIMDAligned(buffer + i)) {
+        scan(buffer[i++]);
+    }
+    if (i + lanes <= sampleCount) {
+        SIMD low = SIMD::expand(0.0f);
+        SIMD high = SIMD::expand(0.0f);
+        auto nanMask = SIMD::vMaskType::expand(0);
+        for (; i + lanes <= sampleCount; i += lanes) {
+            SIMD x = SIMD::fromRawArray(buffer + i);
+            low = SIMD::min(low, x);
+            high = SIMD::max(high, x);
+            nanMask = nanMask | SIMD::notEqual(x, x);
+        }
+        for (size_t lane = 0; lane < SIMD::size(); ++lane) {
+            scan(low.get(lane));
+            scan(high.get(lane));
+            nan = nan || (nanMask.get(lane) != 0);
         }
-        if (silence) {
-            memset(buffer, 0, sampleCount * sizeof(float));
-            return;
+    }
+    while (i < sampleCount) {
+        scan(buffer[i++]);
+    }
+
+    OutputProblem problem;
+    if (nan) {
+        DBG("!!! WARNING: nan detected in audio buffer, silencing !!!");
+        counters.nan.fetch_add(1, std::memory_order_relaxed);
+        problem = OutputProblem::nan;
+    } else if (std::isinf(lowest) || std::isinf(highest)) {
+        DBG("!!! WARNING: inf detected in audio buffer, silencing !!!");
+        counters.inf.fetch_add(1, std::memory_order_relaxed);
+        problem = OutputProblem::inf;
+    } else if (lowest < -2.0f || highest > 2.0f) {  // screaming feedback
+        DBG("!!! WARNING: sample out of range, silencing !!!");
+        counters.tooLoud.fetch_add(1, std::memory_order_relaxed);
+        problem = OutputProblem::tooLoud;
+    } else {
+        if (lowest < -1.0f || highest > 1.0f) {
+            DBG("!!! WARNING: sample out of range, clamping !!!");
+            counters.clamped.fetch_add(1, std::memory_order_relaxed);
+            juce::FloatVectorOperations::clip(buffer, buffer, -1.0f, 1.0f, sampleCount);
+            return OutputProblem::clamped;
         }
+        return OutputProblem::none;
     }
+    juce::FloatVectorOperations::clear(buffer, sampleCount);
+    return problem;
 }
 
 // Returns a typed pointer to a juce::AudioParameterXXX object from the APVTS.
@@ -23,9 +23,16 @@ struct Voice
     Oscillator osc1;
     Oscillator osc2;
 
+    // Which oscillator engine to use: false = BLIT, true = PolyBLEP.
+    bool polyBLEP;
+
     // Integrates the outputs from the oscillators to produce a sawtooth wave.
     float saw;
 
+    // How much the integrator leaks per sample with the BLIT engine. This
+    // depends on the sample rate, so Synth sets it.
+    float leak;
+
     // Amplitude envelope.
     Envelope env;
 
@@ -50,10 +57,18 @@ struct Voice
     // Panning amounts for left and right channels.
     float panLeft, panRight;
 
+    // Use the standard library instead of the FastMath approximations.
+    // Set this with setPreciseMath, which also tells the oscillators and
+    // the filter.
+    bool preciseMath;
+
     void reset()
     {
         note = 0;
         saw = 0.0f;
+        polyBLEP = false;
+        leak = 0.997f;
+        setPreciseMath(false);
 
         osc1.reset();
         osc2.reset();
@@ -65,37 +80,68 @@ struct Voice
         panRight = 0.707f;
     }
 
-    float render(float input)
+    // Output from both oscillators. With the BLIT engine these are impulse
+    // trains, with PolyBLEP they're already sawtooth waves.
+    inline float nextOscillatorSample()
+    {
+        if (polyBLEP) {
+            return osc1.nextSawtooth() - osc2.nextSawtooth();
+        }
+        return osc1.nextSample() - osc2.nextSample();
+    }
+
+    // Coefficient for the integrator. The PolyBLEP sawtooth doesn't need to
+    // be integrated, so then the integrator simply passes it on.
+    inline float integratorLeak() const
     {
-        // The two oscillators output a bandlimited impulse train, which
-        // consists of a sinc pulse every `period` samples.
-        float sample1 = osc1.nextSample();
-        float sample2 = osc2.nextSample();
-
-        // By adding up the sinc pulses over time, i.e. by integrating them,
-        // this creates a bandlimited sawtooth wave without much aliasing.
-        // Subtracting the osc2 sawtooth from osc1 creates a square wave.
-        // For the best results, osc2 should be detuned otherwise it will
-        // cancel out with osc1 and give silence.
-        saw = saw * 0.997f + sample1 - sample2;
-
-        // Note: It can be a little unpredictable how these two oscillators
-        // interact. The oscillator state is not reset when an old voice is
-        // reused for a new note, and so the phase difference between osc1
-        // and osc2 is never the same -- which is part of the fun.
-
-        // Combine the output from the oscillators with the noise.
-        float output = saw + input;
-
-        // Apply the resonant low-pass filter.
-        output = filter.render(output);
-
-        // Amplitude envelope.
-        float envelope = env.nextValue();
-
-        // The output for this voice is the amplitude envelope times the
-        // output from the filter.
-        return output * envelope;
+        return polyBLEP ? 0.0f : leak;
+    }
+
+    // Renders `sampleCount` samples into `output`. This is called once per
+    // control period, so nothing in here changes during the block. `input`
+    // is the noise that gets mixed in. Returns the number of samples that
+    // were rendered before the voice became inactive; the rest is zero.
+    int renderBlock(const float* input, float* output, int sampleCount)
+    {
+        // First do the amplitude envelope. This determines how long the voice
+        // is still active, so that the loop below doesn't need to check.
+        int activeSamples = 0;
+        while (activeSamples < sampleCount && env.isActive()) {
+            output[activeSamples++] = env.nextValue();
+        }
+
+        const float leak = integratorLeak();
+
+        for (int i = 0; i < activeSamples; ++i) {
+            // The two BLIT oscillators output a bandlimited impulse train,
+            // which consists of a sinc pulse every `period` samples.
+            float sample = nextOscillatorSample();
+
+            // By adding up the sinc pulses over time, i.e. by integrating them,
+            // this creates a bandlimited sawtooth wave without much aliasing.
+            // Subtracting the osc2 sawtooth from osc1 creates a square wave.
+            // For the best results, osc2 should be detuned otherwise it will
+            // cancel out with osc1 and give silence.
+            saw = saw * leak + sample;
+
+            // Note: It can be a little unpredictable how these two oscillators
+            // interact. The oscillator state is not reset when an old voice is
+            // reused for a new note, and so the phase difference between osc1
+            // and osc2 is never the same -- which is part of the fun.
+
+            // Combine the output from the oscillators with the noise and apply
+            // the resonant low-pass filter.
+            float filtered = filter.render(saw + input[i]);
+
+            // The output for this voice is the amplitude envelope times the
+            // output from the filter.
+            output[i] *= filtered;
+        }
+
+        for (int i = activeSamples; i < sampleCount; ++i) {
+            output[i] = 0.0f;
+        }
+        return activeSamples;
     }
 
     void updatePanning()
@@ -105,11 +151,19 @@ struct Voice
         float panning = std::clamp((note - 60.0f) / 24.0f, -1.0f, 1.0f);
 
         // Use constant power panning formula.
-        panLeft = std::sin(PI_OVER_4 * (1.0f - panning));
-        panRight = std::sin(PI_OVER_4 * (1.0f + panning));
+        panLeft = FastMath::sin(PI_OVER_4 * (1.0f - panning), preciseMath);
+        panRight = FastMath::sin(PI_OVER_4 * (1.0f + panning), preciseMath);
     }
 
     void updateLFO()
+    {
+        updateCutoff(FastMath::exp(updateGlide(), preciseMath));
+    }
+
+    // The two halves of updateLFO, so that Synth can do the exp() in between
+    // for a group of voices at once. The first half does the glide and the
+    // filter envelope, and returns the exponent for the cutoff modulation.
+    float updateGlide()
     {
         // Do the following updates at the LFO update rate.
 
@@ -117,19 +171,33 @@ struct Voice
         period += glideRate * (target - period);
 
         // Update the filter envelope. This is the same equation as for the
-        // amplitude envelope, but only performed every LFO_MAX steps.
+        // amplitude envelope, but only performed once per control period.
         float fenv = filterEnv.nextValue();
+        return filterMod + filterEnvDepth * fenv;
+    }
 
+    // `modulation` is exp() of what updateGlide returned.
+    void updateCutoff(float modulation)
+    {
         // Calculate the filter cutoff frequency. The base `cutoff` is given by
         // the pitch and velocity. This is modulated by a variety of other things
         // such as the filter envelope and the pitch bend.
-        float modulatedCutoff = cutoff * std::exp(filterMod + filterEnvDepth * fenv) / pitchBend;
+        float modulatedCutoff = cutoff * modulation / pitchBend;
 
         // Make sure the cutoff frequency stays within reasonable bounds.
         modulatedCutoff = std::clamp(modulatedCutoff, 30.0f, 20000.0f);
 
-        // Tell the filter to recalculate its coefficients.
-        filter.updateCoefficients(modulatedCutoff, filterQ);
+        // Tell the filter to move its coefficients to the new cutoff over the
+        // course of the next control period.
+        filter.rampCoefficients(modulatedCutoff, filterQ);
+    }
+
+    void setPreciseMath(bool precise)
+    {
+        preciseMath = precise;
+        osc1.preciseMath = precise;
+        osc2.preciseMath = precise;
+        filter.preciseMath = precise;
     }
 
     void release()
@@ -137,4 +205,17 @@ struct Voice
         env.release();
         filterEnv.release();
     }
+
+    // Converts everything that is measured in samples when the voice moves
+    // to a different sample rate while it's playing. `ratio` is the new rate
+    // divided by the old one. The filter envelope runs at the control rate,
+    // which doesn't change.
+    void changeSampleRate(float ratio)
+    {
+        period *= ratio;
+        target *= ratio;
+        osc1.changeSampleRate(ratio);
+        osc2.changeSampleRate(ratio);
+        env.changeSampleRate(ratio);
+    }
 };
@@ -0,0 +1,390 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include "Voice.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// A set of numbers from 0 to 127, one bit each. Used for sets of voices and
+// for sets of MIDI notes.
+class BitSet128
+{
+public:
+    void set(int i) { words[i >> 6] |= bit(i); }
+    void clear(int i) { words[i >> 6] &= ~bit(i); }
+    bool test(int i) const { return (words[i >> 6] & bit(i)) != 0; }
+    bool isEmpty() const { return (words[0] | words[1]) == 0; }
+
+    // The lowest and highest number in the set, or -1 if the set is empty.
+    int first() const
+    {
+        if (words[0] != 0) { return lowestBit(words[0]); }
+        if (words[1] != 0) { return 64 + lowestBit(words[1]); }
+        return -1;
+    }
+
+    int last() const
+    {
+        if (words[1] != 0) { return 64 + highestBit(words[1]); }
+        if (words[0] != 0) { return highestBit(words[0]); }
+        return -1;
+    }
+
+    // The lowest number below `limit` that is not in the set, or -1.
+    int firstMissing(int limit) const
+    {
+        BitSet128 missing;
+        missing.words[0] = ~words[0];
+        missing.words[1] = ~words[1];
+        int i = missing.first();
+        return (i >= 0 && i < limit) ? i : -1;
+    }
+
+    // Calls `function` for every number in the set, from low to high. The
+    // set may be changed while this runs, because it loops over a copy.
+    template<typename Function>
+    void forEach(Function&& function) const
+    {
+        for (int w = 0; w < 2; ++w) {
+            uint64_t bits = words[w];
+            while (bits != 0) {
+                function(w * 64 + lowestBit(bits));
+                bits &= bits - 1;  // remove the lowest bit
+            }
+        }
+    }
+
+    // Keeps the numbers below `limit`.
+    BitSet128 below(int limit) const
+    {
+        BitSet128 result = *this;
+        for (int w = 0; w < 2; ++w) {
+            int count = std::clamp(limit - w * 64, 0, 64);
+            result.words[w] &= (count == 64) ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+        }
+        return result;
+    }
+
+    BitSet128 without(const BitSet128& other) const
+    {
+        BitSet128 result;
+        result.words[0] = words[0] & ~other.words[0];
+        result.words[1] = words[1] & ~other.words[1];
+        return result;
+    }
+
+private:
+    static uint64_t bit(int i) { return uint64_t(1) << (i & 63); }
+
+    static int lowestBit(uint64_t x)
+    {
+       #if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward64(&index, x);
+        return int(index);
+       #else
+        return __builtin_ctzll(x);
+       #endif
+    }
+
+    static int highestBit(uint64_t x)
+    {
+       #if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, x);
+        return int(index);
+       #else
+        return 63 - __builtin_clzll(x);
+       #endif
+    }
+
+    uint64_t words[2] = { 0, 0 };
+};
+
+// Decides which voice plays a new note, and finds the voices that play a
+// given note, without looping through all the voices.
+//
+// Synth tells the allocator about every change to a voice's note and about
+// voices that start or stop playing. From that, the allocator keeps a set of
+// playing voices, so that finding a free voice is a matter of finding the
+// first zero bit, and a set of voices for every note, so that a note off
+// only touches the voices that play that note. The voices are also kept in
+// a list from oldest to newest note.
+//
+// When all voices are playing, one of them is stolen. The envelope levels
+// change on every sample, so the quietest voice can't be kept in a sorted
+// structure; it is found by looking at the playing voices, but only when
+// there is no free voice.
+class VoiceAllocator
+{
+public:
+    static constexpr int MAX_VOICES = 128;
+
+    // Special "note number" for a voice that is only kept alive by the
+    // sustain pedal. This is the same as SUSTAIN in Synth.
+    static constexpr int SUSTAINED = -1;
+
+    // How to choose a voice to steal when all voices are playing.
+    struct Policy
+    {
+        // Steal the voice that has been playing the longest, instead of the
+        // quietest voice that is not in its attack stage.
+        bool oldest = false;
+
+        // If the note is already sounding, play it on the same voice again,
+        // even if there are free voices. Otherwise the same note can end up
+        // on two voices at once, which makes it louder and phasey.
+        bool retriggerSameNote = false;
+
+        // Don't steal the voices that play the lowest or highest key that is
+        // held down, so that the bass line or the melody doesn't drop out.
+        bool protectLowestNote = false;
+        bool protectHighestNote = false;
+    };
+
+    void reset()
+    {
+        playing = BitSet128();
+        sustained = BitSet128();
+        heldNotes = BitSet128();
+        for (auto& voicesForNote : voicesWithNote) { voicesForNote = BitSet128(); }
+        for (int v = 0; v < MAX_VOICES; ++v) {
+            voiceNote[size_t(v)] = 0;
+            startedNote[size_t(v)] = 0;
+            older[size_t(v)] = -1;
+            newer[size_t(v)] = -1;
+            inAgeList[size_t(v)] = false;
+        }
+        lastVoiceForNote.fill(-1);
+        oldestVoice = -1;
+        newestVoice = -1;
+    }
+
+    bool isPlaying(int v) const { return playing.test(v); }
+
+    // The voice became active, or inactive because its envelope ended.
+    void voiceStarted(int v)
+    {
+        playing.set(v);
+        addToNoteSet(v);
+    }
+
+    void voiceStopped(int v)
+    {
+        removeFromNoteSet(v);
+        playing.clear(v);
+        removeFromAgeList(v);
+    }
+
+    // Call this whenever Voice::note changes: 0 means no key is held, or
+    // SUSTAINED. Only the voices that are playing are in the note sets.
+    void setNote(int v, int note)
+    {
+        removeFromNoteSet(v);
+        voiceNote[size_t(v)] = note;
+        addToNoteSet(v);
+    }
+
+    // The voice starts playing a new note. This makes it the newest voice.
+    void noteStarted(int v, int note)
+    {
+        removeFromAgeList(v);
+        older[size_t(v)] = newestVoice;
+        newer[size_t(v)] = -1;
+        if (newestVoice >= 0) {
+            newer[size_t(newestVoice)] = v;
+        } else {
+            oldestVoice = v;
+        }
+        newestVoice = v;
+        inAgeList[size_t(v)] = true;
+
+        startedNote[size_t(v)] = note;
+        if (note > 0) {
+            lastVoiceForNote[size_t(note)] = v;
+        }
+    }
+
+    // The playing voices whose key for `note` is still held down, or with
+    // SUSTAINED, the voices that are kept alive by the sustain pedal.
+    BitSet128 voicesPlaying(int note) const
+    {
+        if (note == SUSTAINED) { return sustained; }
+        if (note > 0 && note < 128) { return voicesWithNote[size_t(note)]; }
+        return BitSet128();
+    }
+
+    // Is any key held down for one of the playing voices?
+    bool isAnyNoteHeld() const { return !heldNotes.isEmpty(); }
+
+    // Chooses the voice for a new note from the first `numVoices` voices.
+    // `voices` is needed to look at the envelopes of the playing voices.
+    int chooseVoice(int note, int numVoices, const Voice* voices, const Policy& policy) const
+    {
+        if (policy.retriggerSameNote && note > 0) {
+            int v = lastVoiceForNote[size_t(note)];
+            if (v >= 0 && v < numVoices && playing.test(v) && startedNote[size_t(v)] == note) {
+                return v;
+            }
+        }
+
+        // Use the lowest voice that is not playing.
+        int v = playing.firstMissing(numVoices);
+        if (v >= 0) { return v; }
+
+        // All voices are playing, so one must be stolen. Try without the
+        // protected voices first. If they are the only ones left, or all
+        // others are in their attack stage, steal one of them anyway.
+        BitSet128 candidates = playing.below(numVoices);
+        BitSet128 unprotected = candidates.without(protectedVoices(policy));
+        if (policy.oldest) {
+            v = findOldest(unprotected);
+            return (v >= 0) ? v : findOldest(candidates);
+        }
+        v = findQuietest(unprotected, voices);
+        return (v >= 0) ? v : std::max(findQuietest(candidates, voices), 0);
+    }
+
+private:
+    void addToNoteSet(int v)
+    {
+        if (!playing.test(v)) { return; }
+        int note = voiceNote[size_t(v)];
+        if (note == SUSTAINED) {
+            sustained.set(v);
+        } else if (note > 0) {
+            voicesWithNote[size_t(note)].set(v);
+            heldNotes.set(note);
+        }
+    }
+
+    void removeFromNoteSet(int v)
+    {
+        if (!playing.test(v)) { return; }
+        int note = voiceNote[size_t(v)];
+        if (note == SUSTAINED) {
+            sustained.clear(v);
+        } else if (note > 0) {
+            voicesWithNote[size_t(note)].clear(v);
+            if (voicesWithNote[size_t(note)].isEmpty()) { heldNotes.clear(note); }
+        }
+    }
+
+    void removeFromAgeList(int v)
+    {
+        if (!inAgeList[size_t(v)]) { return; }
+        int o = older[size_t(v)];
+        int n = newer[size_t(v)];
+        if (o >= 0) { newer[size_t(o)] = n; } else { oldestVoice = n; }
+        if (n >= 0) { older[size_t(n)] = o; } else { newestVoice = o; }
+        inAgeList[size_t(v)] = false;
+    }
+
+    BitSet128 protectedVoices(const Policy& policy) const
+    {
+        BitSet128 result;
+        if (policy.protectLowestNote && isAnyNoteHeld()) {
+            result = voicesWithNote[size_t(heldNotes.first())];
+        }
+        if (policy.protectHighestNote && isAnyNoteHeld()) {
+            voicesWithNote[size_t(heldNotes.last())].forEach([&](int v) { result.set(v); });
+        }
+        return result;
+    }
+
+    int findOldest(const BitSet128& candidates) const
+    {
+        for (int v = oldestVoice; v >= 0; v = newer[size_t(v)]) {
+            if (candidates.test(v)) { return v; }
+        }
+        return -1;
+    }
+
+    // The voice with the lowest envelope level that is not in its attack
+    // stage. On a tie, this picks the lowest voice number.
+    static int findQuietest(const BitSet128& candidates, const Voice* voices)
+    {
+        int quietest = -1;
+        float lowest = 100.0f;  // louder than any envelope!
+        candidates.forEach([&](int v) {
+            const Envelope& env = voices[v].env;
+            if (!env.isInAttack() && env.level < lowest) {
+                lowest = env.level;
+                quietest = v;
+            }
+        });
+        return quietest;
+    }
+
+    // The voices that are playing.
+    BitSet128 playing;
+
+    // The playing voices for every note whose key is held down, and the
+    // notes for which that set is not empty.
+    std::array<BitSet128, 128> voicesWithNote;
+    BitSet128 heldNotes;
+
+    // The playing voices that are kept alive by the sustain pedal.
+    BitSet128 sustained;
+
+    // The allocator's copy of Voice::note.
+    std::array<int, MAX_VOICES> voiceNote;
+
+    // The note that each voice was last started with. Unlike Voice::note,
+    // this stays the same after the key is released.
+    std::array<int, MAX_VOICES> startedNote;
+
+    // The voice that most recently started each note.
+    std::array<int, 128> lastVoiceForNote;
+
+    // Linked list of the voices in the order that their notes started.
+    std::array<int, MAX_VOICES> older;
+    std::array<int, MAX_VOICES> newer;
+    std::array<bool, MAX_VOICES> inAgeList;
+    int oldestVoice;
+    int newestVoice;
+};
+
+// The keys that are held down in mono mode, other than the one that is
+// playing. When that key is released, the most recent key from the stack
+// takes over. If the stack is full, the oldest key is forgotten.
+class NoteStack
+{
+public:
+    static constexpr int CAPACITY = 16;
+
+    void clear() { count = 0; }
+
+    void push(int note)
+    {
+        if (count == CAPACITY) {
+            std::copy(notes.begin() + 1, notes.end(), notes.begin());
+            count -= 1;
+        }
+        notes[size_t(count++)] = note;
+    }
+
+    // Removes and returns the most recent note, or 0 if the stack is empty.
+    int pop()
+    {
+        return (count > 0) ? notes[size_t(--count)] : 0;
+    }
+
+    // Forgets the note when its key is released.
+    void remove(int note)
+    {
+        int kept = 0;
+        for (int i = 0; i < count; ++i) {
+            if (notes[size_t(i)] != note) { notes[size_t(kept++)] = notes[size_t(i)]; }
+        }
+        count = kept;
+    }
+
+private:
+    std::array<int, CAPACITY> notes;
+    int count = 0;
+};
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "FastMath.h"
+#include "Voice.h"
+
+// Renders a group of voices at the same time using SIMD instructions. Each
+// lane of a SIMD register holds the state for one voice, so with SSE or NEON
+// four voices are processed per instruction. JUCE would use eight lanes with
+// AVX, but none of the projects compile for AVX, so LANES is always 4.
+//
+// Only the audio-rate work that is identical for every voice happens in the
+// SIMD registers: the sawtooth integrator, the noise mix, the SVF filter and
+// its coefficient ramps, the amplitude envelope, and the panning. The
+// oscillators are still scalar because each voice starts a new cycle at a
+// different moment, and that code is full of branches.
+//
+// The state of the voices is copied into lane-aligned arrays by `load` and
+// copied back by `store`. Synth does this once per control period, which is
+// cheap compared to rendering the samples of that period.
+//
+// The output matches the one-voice-at-a-time path in Voice::renderBlock
+// within TOLERANCE, relative to the loudest sample. Usually it's the same bit
+// for bit, but where the compiler fuses multiplies and adds differently in
+// the two paths, the rounding errors add up to a few times 1e-6. Just like in
+// the scalar path, a voice stops as soon as its envelope drops below SILENCE,
+// even halfway through a block.
+//
+// Note: this needs the Cytomic SVF from Filter.h, not the ladder filter.
+class VoiceBank
+{
+public:
+    using SIMD = juce::dsp::SIMDRegister<float>;
+    using Mask = SIMD::vMaskType;
+
+    // Number of voices that are rendered at once.
+    static constexpr int LANES = int(SIMD::SIMDNumElements);
+
+    // Longest block that can be rendered in one go. This is the longest
+    // possible control period.
+    static constexpr int MAX_SAMPLES = 256;
+
+    // How far the output may be from the scalar path, relative to the
+    // loudest sample. JX11Bench --accuracy checks this for every preset.
+    static constexpr double TOLERANCE = 1e-5;
+
+    // Copies the state of up to LANES voices into the lanes. Unused lanes
+    // are silent.
+    void load(Voice* const* voicesToLoad, int count)
+    {
+        jassert(count > 0 && count <= LANES);
+        numVoices = count;
+
+        for (int lane = 0; lane < LANES; ++lane) {
+            if (lane < count) {
+                Voice& v = *voicesToLoad[lane];
+                voices[lane] = &v;
+
+                saw[lane] = v.saw;
+                leak[lane] = v.integratorLeak();
+
+                a1[lane] = v.filter.a1;
+                a2[lane] = v.filter.a2;
+                a3[lane] = v.filter.a3;
+                a1Step[lane] = v.filter.a1Step;
+                a2Step[lane] = v.filter.a2Step;
+                a3Step[lane] = v.filter.a3Step;
+                ic1eq[lane] = v.filter.ic1eq;
+                ic2eq[lane] = v.filter.ic2eq;
+
+                level[lane] = v.env.level;
+                target[lane] = v.env.target;
+                multiplier[lane] = v.env.multiplier;
+                decayMultiplier[lane] = v.env.decayMultiplier;
+                sustainLevel[lane] = v.env.sustainLevel;
+
+                panLeft[lane] = v.panLeft;
+                panRight[lane] = v.panRight;
+            } else {
+                voices[lane] = nullptr;
+                saw[lane] = leak[lane] = 0.0f;
+                a1[lane] = a2[lane] = a3[lane] = 0.0f;
+                a1Step[lane] = a2Step[lane] = a3Step[lane] = 0.0f;
+                ic1eq[lane] = ic2eq[lane] = 0.0f;
+                level[lane] = target[lane] = multiplier[lane] = 0.0f;
+                decayMultiplier[lane] = sustainLevel[lane] = 0.0f;
+                panLeft[lane] = panRight[lane] = 0.0f;
+            }
+        }
+    }
+
+    // Renders the voices and adds their output to the left and right buffers.
+    // `noise` holds the noise signal that is mixed into every voice.
+    void render(const float* noise, float* outputLeft, float* outputRight, int sampleCount)
+    {
+        jassert(sampleCount <= MAX_SAMPLES);
+
+        // The amplitude envelope does not depend on anything else, so it can
+        // be computed up front. This is Envelope::nextValue for every lane.
+        // A voice whose level drops below SILENCE is done: its envelope is
+        // frozen and outputs zero from then on, and `activeSamples` tells us
+        // for how many samples the voice was still playing.
+        SIMD vLevel = SIMD::fromRawArray(level);
+        SIMD vTarget = SIMD::fromRawArray(target);
+        SIMD vMultiplier = SIMD::fromRawArray(multiplier);
+        SIMD vDecayMultiplier = SIMD::fromRawArray(decayMultiplier);
+        SIMD vSustainLevel = SIMD::fromRawArray(sustainLevel);
+        SIMD vActiveSamples = SIMD::expand(0.0f);
+        const SIMD vSilence = SIMD::expand(SILENCE);
+        const SIMD vAttackDone = SIMD::expand(3.0f);
+        const SIMD vOne = SIMD::expand(1.0f);
+
+        for (int i = 0; i < sampleCount; ++i) {
+            Mask active = SIMD::greaterThan(vLevel, vSilence);
+
+            SIMD newLevel = vMultiplier * (vLevel - vTarget) + vTarget;
+
+            // Done with the attack? Then go into decay.
+            Mask decay = SIMD::greaterThan(newLevel + vTarget, vAttackDone) & active;
+            vMultiplier = FastMath::select(decay, vDecayMultiplier, vMultiplier);
+            vTarget = FastMath::select(decay, vSustainLevel, vTarget);
+
+            vLevel = FastMath::select(active, newLevel, vLevel);
+            (newLevel & active).copyToRawArray(envBuffer + i * LANES);
+            vActiveSamples += vOne & active;
+        }
+
+        vLevel.copyToRawArray(level);
+        vTarget.copyToRawArray(target);
+        vMultiplier.copyToRawArray(multiplier);
+        vActiveSamples.copyToRawArray(activeSamples);
+
+        // Run the oscillators, one voice at a time. The samples are interleaved
+        // so that every time step is one aligned SIMD load.
+        for (int lane = 0; lane < LANES; ++lane) {
+            int count = (lane < numVoices) ? int(activeSamples[lane]) : 0;
+            if (count > 0) {
+                Voice& v = *voices[lane];
+                for (int i = 0; i < count; ++i) {
+                    oscBuffer[i * LANES + lane] = v.nextOscillatorSample();
+                }
+            }
+            for (int i = count; i < sampleCount; ++i) {
+                oscBuffer[i * LANES + lane] = 0.0f;
+            }
+        }
+
+        SIMD vSaw = SIMD::fromRawArray(saw);
+        SIMD vLeak = SIMD::fromRawArray(leak);
+        SIMD vA1 = SIMD::fromRawArray(a1);
+        SIMD vA2 = SIMD::fromRawArray(a2);
+        SIMD vA3 = SIMD::fromRawArray(a3);
+        SIMD vA1Step = SIMD::fromRawArray(a1Step);
+        SIMD vA2Step = SIMD::fromRawArray(a2Step);
+        SIMD vA3Step = SIMD::fromRawArray(a3Step);
+        SIMD vIc1eq = SIMD::fromRawArray(ic1eq);
+        SIMD vIc2eq = SIMD::fromRawArray(ic2eq);
+        const SIMD vZero = SIMD::expand(0.0f);
+
+        for (int i = 0; i < sampleCount; ++i) {
+            SIMD envelope = SIMD::fromRawArray(envBuffer + i * LANES);
+            Mask active = SIMD::greaterThan(envelope, vZero);
+
+            // Integrate the impulse trains into a sawtooth and add the noise.
+            // This is the same as in Voice::renderBlock. The sawtooth is kept
+            // for the next note on this voice, so don't let it change after
+            // the voice is done.
+            SIMD newSaw = vSaw * vLeak + SIMD::fromRawArray(oscBuffer + i * LANES);
+            vSaw = FastMath::select(active, newSaw, vSaw);
+            SIMD x = vSaw + noise[i];
+
+            // The SVF from Filter::render, including the coefficient ramps.
+            vA1 += vA1Step;
+            vA2 += vA2Step;
+            vA3 += vA3Step;
+            SIMD v3 = x - vIc2eq;
+            SIMD v1 = vA1 * vIc1eq + vA2 * v3;
+            SIMD v2 = vIc2eq + vA2 * vIc1eq + vA3 * v3;
+            vIc1eq = v1 * 2.0f - vIc1eq;
+            vIc2eq = v2 * 2.0f - vIc2eq;
+
+            // Apply the amplitude envelope. Voices that are done output zero.
+            // Their filter state keeps going but Synth resets it afterwards.
+            // The oscillator samples for this step have been used, so their
+            // place in oscBuffer is reused for the output.
+            SIMD output = v2 * envelope;
+            output.copyToRawArray(oscBuffer + i * LANES);
+        }
+
+        // Pan the voices and add them to the outputs one lane at a time, in
+        // the same order as the scalar path. This is cheaper than adding up
+        // the lanes of a SIMD register for every sample.
+        for (int lane = 0; lane < numVoices; ++lane) {
+            const float left = panLeft[lane];
+            const float right = panRight[lane];
+            for (int i = 0; i < sampleCount; ++i) {
+                float sample = oscBuffer[i * LANES + lane];
+                outputLeft[i] += sample * left;
+                outputRight[i] += sample * right;
+            }
+        }
+
+        vSaw.copyToRawArray(saw);
+        vA1.copyToRawArray(a1);
+        vA2.copyToRawArray(a2);
+        vA3.copyToRawArray(a3);
+        vIc1eq.copyToRawArray(ic1eq);
+        vIc2eq.copyToRawArray(ic2eq);
+    }
+
+    // Copies the new state back into the voices.
+    void store()
+    {
+        for (int lane = 0; lane < numVoices; ++lane) {
+            Voice& v = *voices[lane];
+            v.saw = saw[lane];
+            v.filter.a1 = a1[lane];
+            v.filter.a2 = a2[lane];
+            v.filter.a3 = a3[lane];
+            v.filter.ic1eq = ic1eq[lane];
+            v.filter.ic2eq = ic2eq[lane];
+            v.env.level = level[lane];
+            v.env.target = target[lane];
+            v.env.multiplier = multiplier[lane];
+        }
+    }
+
+private:
+    Voice* voices[LANES];
+    int numVoices = 0;
+
+    alignas(SIMD::SIMDRegisterSize) float saw[LANES];
+    alignas(SIMD::SIMDRegisterSize) float leak[LANES];
+
+    // Filter coefficients and state.
+    alignas(SIMD::SIMDRegisterSize) float a1[LANES];
+    alignas(SIMD::SIMDRegisterSize) float a2[LANES];
+    alignas(SIMD::SIMDRegisterSize) float a3[LANES];
+    alignas(SIMD::SIMDRegisterSize) float a1Step[LANES];
+    alignas(SIMD::SIMDRegisterSize) float a2Step[LANES];
+    alignas(SIMD::SIMDRegisterSize) float a3Step[LANES];
+    alignas(SIMD::SIMDRegisterSize) float ic1eq[LANES];
+    alignas(SIMD::SIMDRegisterSize) float ic2eq[LANES];
+
+    // Amplitude envelope.
+    alignas(SIMD::SIMDRegisterSize) float level[LANES];
+    alignas(SIMD::SIMDRegisterSize) float target[LANES];
+    alignas(SIMD::SIMDRegisterSize) float multiplier[LANES];
+    alignas(SIMD::SIMDRegisterSize) float decayMultiplier[LANES];
+    alignas(SIMD::SIMDRegisterSize) float sustainLevel[LANES];
+
+    alignas(SIMD::SIMDRegisterSize) float panLeft[LANES];
+    alignas(SIMD::SIMDRegisterSize) float panRight[LANES];
+
+    // Number of samples that each voice was still active.
+    alignas(SIMD::SIMDRegisterSize) float activeSamples[LANES];
+
+    // Oscillator output and envelope values, interleaved by lane.
+    alignas(SIMD::SIMDRegisterSize) float oscBuffer[MAX_SAMPLES * LANES];
+    alignas(SIMD::SIMDRegisterSize) float envBuffer[MAX_SAMPLES * LANES];
+};
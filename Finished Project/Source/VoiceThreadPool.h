@@ -0,0 +1,183 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "Semaphore.h"
+
+// A small pool of worker threads that help the audio thread render voices.
+//
+// The threads are started by Synth::startWorkerThreads, never on the audio
+// thread. When there is no work, they sleep on a Semaphore. The audio thread
+// calls `run` with a number of jobs, wakes up the workers, and then does jobs
+// itself until there are none left. Workers grab the next job with a
+// compare-and-swap on an atomic counter. Neither handing out the work nor
+// waking up the threads takes a lock, so the audio thread never waits for a
+// mutex that a lower-priority thread holds.
+//
+// Which thread does which job is random, so each job must write its results
+// into its own buffer. The caller then mixes these buffers in a fixed order
+// to get the same output no matter how many threads there are.
+class VoiceThreadPool
+{
+public:
+    // A job is a plain function pointer plus a context pointer, so that `run`
+    // doesn't need to allocate memory. `thread` is 0 for the audio thread and
+    // 1 ... getNumThreads() for the workers.
+    using JobFunction = void (*)(void* context, int job, int thread);
+
+    ~VoiceThreadPool()
+    {
+        stop();
+    }
+
+    void start(int numThreads)
+    {
+        stop();
+        for (int i = 0; i < numThreads; ++i) {
+            workers.push_back(std::make_unique<Worker>(*this, i + 1));
+            workers.back()->startRealtimeThread(juce::Thread::RealtimeOptions{});
+        }
+    }
+
+    void stop()
+    {
+        for (auto& worker : workers) {
+            worker->signalThreadShouldExit();
+            worker->wakeUp.signal();
+        }
+        for (auto& worker : workers) {
+            worker->stopThread(1000);
+        }
+        workers.clear();
+    }
+
+    // Number of worker threads, not counting the audio thread.
+    int getNumThreads() const
+    {
+        return int(workers.size());
+    }
+
+    // Performs jobs 0 to numJobs - 1 and returns when they are all done.
+    void run(JobFunction function, void* context, int numJobs)
+    {
+        jassert(numJobs <= JOB_MASK);
+
+        jobFunction = function;
+        jobContext = context;
+        jobCount.store(numJobs, std::memory_order_relaxed);
+        jobsDone.store(0, std::memory_order_relaxed);
+
+        // Starting a new generation makes the jobs visible to the workers.
+        // A worker that is still busy with the previous generation cannot
+        // accidentally grab one of the new jobs.
+        generation = (generation + 1) & GENERATION_MASK;
+        nextJob.store(generation << GENERATION_SHIFT, std::memory_order_release);
+
+        for (auto& worker : workers) {
+            worker->wakeUp.signal();
+        }
+
+        doJobs(generation, 0);
+
+        // Wait for the workers to finish the jobs they're still working on.
+        // Usually that's only a moment, so first give up the time slice a few
+        // times. If the workers take longer, for example because the system
+        // is busy, sleep until the last one is done.
+        for (int spin = 0; spin < MAX_SPINS; ++spin) {
+            if (jobsDone.load(std::memory_order_acquire) == numJobs) { return; }
+            std::this_thread::yield();
+        }
+
+        // The worker that finishes the last job only signals allDone if it
+        // takes `waiting`, so that no signals are left over for the next
+        // call. If it took `waiting` just after the check, its signal must be
+        // eaten. A worker that is still finishing the previous call may also
+        // take `waiting`, which is why jobsDone is checked again.
+        while (jobsDone.load() < numJobs) {
+            waiting.store(true);
+            if (jobsDone.load() < numJobs || !waiting.exchange(false)) {
+                allDone.wait();
+            }
+        }
+    }
+
+private:
+    class Worker : public juce::Thread
+    {
+    public:
+        Worker(VoiceThreadPool& pool_, int index_)
+            : juce::Thread("JX11 Voice Renderer"), pool(pool_), index(index_) { }
+
+        void run() override
+        {
+            // The denormal flags are per thread, so set them here too.
+            juce::ScopedNoDenormals noDenormals;
+
+            while (true) {
+                wakeUp.wait();
+                if (threadShouldExit()) { break; }
+
+                uint32_t current = pool.nextJob.load(std::memory_order_acquire);
+                pool.doJobs(current >> GENERATION_SHIFT, index);
+            }
+        }
+
+        Semaphore wakeUp;
+
+    private:
+        VoiceThreadPool& pool;
+        int index;
+    };
+
+    void doJobs(uint32_t jobGeneration, int thread)
+    {
+        int job;
+        while (claimJob(jobGeneration, job)) {
+            jobFunction(jobContext, job, thread);
+            int done = jobsDone.fetch_add(1) + 1;
+            if (thread != 0 && done == jobCount.load(std::memory_order_relaxed)
+                    && waiting.exchange(false)) {
+                allDone.signal();
+            }
+        }
+    }
+
+    bool claimJob(uint32_t jobGeneration, int& job)
+    {
+        uint32_t current = nextJob.load(std::memory_order_acquire);
+        for (;;) {
+            if ((current >> GENERATION_SHIFT) != jobGeneration) { return false; }
+
+            job = int(current & JOB_MASK);
+            if (job >= jobCount.load(std::memory_order_relaxed)) { return false; }
+
+            if (nextJob.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel)) {
+                return true;
+            }
+        }
+    }
+
+    // The upper bits of `nextJob` hold the generation, the lower bits the
+    // index of the next job that hasn't been claimed yet.
+    static constexpr int GENERATION_SHIFT = 16;
+    static constexpr uint32_t GENERATION_MASK = 0xFFFF;
+    static constexpr int JOB_MASK = 0xFFFF;
+
+    // How many times `run` yields before it sleeps.
+    static constexpr int MAX_SPINS = 16;
+
+    std::atomic<uint32_t> nextJob { 0 };
+    std::atomic<int> jobCount { 0 };
+    std::atomic<int> jobsDone { 0 };
+    uint32_t generation = 0;
+
+    // Set by `run` when it goes to sleep on allDone. These use the default
+    // sequentially consistent ordering, so that either `run` sees that the
+    // last job is done, or the worker that did it sees `waiting`.
+    std::atomic<bool> waiting { false };
+    Semaphore allDone;
+
+    JobFunction jobFunction = nullptr;
+    void* jobContext = nullptr;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+};